@@ -0,0 +1,348 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define COOKED_USE_MMAP
+#endif
+#include "pack.h"
+
+// Binary scenes (.scenec) and templates (.templatec) written by the cooker. Every record is a fixed size POD
+// stored in a section of the file; records refer to each other and to the string table by index.
+// Scene actors carry their resolved name, pre-sorted component keys and component types resolved from their template,
+// so the engine can instantiate them without building a JSON DOM.
+namespace cooked {
+
+constexpr char magic[4] = { 'M', 'R', 'C', 'K' };
+constexpr uint32_t version = 3;
+constexpr uint32_t none = 0xffffffff;
+// deepest nesting of arrays and objects open() accepts, so reading a value never recurses further
+constexpr uint32_t max_depth = 64;
+
+enum class Kind : uint32_t {
+	Scene,
+	Template,
+};
+
+enum class ValueType : uint32_t {
+	Nil,
+	Bool,
+	Int,
+	Number,
+	String,
+	Array,  // elements are values[index, index + count)
+	Object, // members are fields[index, index + count)
+};
+
+struct Section {
+	uint32_t offset;
+	uint32_t count;
+};
+
+struct Header {
+	char magic[4];
+	uint32_t version;
+	Kind kind;
+	uint32_t string_bytes; // offset of the character data the string table points into
+	Section strings;
+	Section values;
+	Section fields;
+	Section components;
+	Section actors;
+	uint32_t preload; // a scene's "preload" object, an Object value, or none
+	Section dependencies; // string indices (uint32_t) naming the templates a scene embeds
+};
+
+struct String {
+	uint32_t offset;
+	uint32_t length;
+};
+
+struct Value {
+	ValueType type;
+	uint32_t count;
+	union {
+		double number;
+		int64_t integer;
+		uint32_t index;
+		uint32_t boolean;
+	};
+};
+
+struct Field {
+	uint32_t name;
+	uint32_t value;
+};
+
+enum ComponentFlags : uint32_t {
+	FromTemplate = 1, // the key exists in the actor's template, which supplies the defaults
+};
+
+struct Component {
+	uint32_t key;
+	uint32_t type;
+	uint32_t flags;
+	Section fields; // overrides, "type" excluded; identical overrides in one file share a range
+};
+
+struct Actor {
+	uint32_t name;
+	uint32_t template_name;
+	Section components;
+};
+
+static_assert(std::is_trivially_copyable_v<Value> && sizeof(Value) == 16);
+
+// A cooked file mapped read-only (or read into memory where mmap is unavailable, or viewed inside the resource pack).
+// open() validates every index, so the accessors can be used without bounds checks afterwards.
+class File {
+	std::string path_;
+	int64_t stamp_ = 0;
+	std::string buffer;
+	const char* data = nullptr;
+	size_t size = 0;
+#ifdef COOKED_USE_MMAP
+	void* mapping = nullptr;
+#endif
+
+	template<class T>
+	const T* section(Section s) const {
+		return reinterpret_cast<const T*>(data + s.offset);
+	}
+
+	template<class T>
+	bool section_valid(Section s) const {
+		return s.offset % alignof(T) == 0 && s.offset <= size && s.count <= (size - s.offset) / sizeof(T);
+	}
+
+	bool range_valid(Section range, uint32_t limit) const {
+		return range.offset <= limit && range.count <= limit - range.offset;
+	}
+
+	bool validate() const {
+		if (size < sizeof(Header) || std::memcmp(header().magic, magic, sizeof(magic)) != 0 || header().version != version) {
+			return false;
+		}
+		const Header& h = header();
+		if (!section_valid<String>(h.strings) || !section_valid<Value>(h.values) || !section_valid<Field>(h.fields)
+			|| !section_valid<Component>(h.components) || !section_valid<Actor>(h.actors) || !section_valid<uint32_t>(h.dependencies)
+			|| h.string_bytes > size) {
+			return false;
+		}
+		if (h.preload != none && (h.preload >= h.values.count || section<Value>(h.values)[h.preload].type != ValueType::Object)) {
+			return false;
+		}
+		const size_t character_bytes = size - h.string_bytes;
+		for (uint32_t i = 0; i < h.strings.count; i++) {
+			const String& s = section<String>(h.strings)[i];
+			// strings are stored null terminated
+			if (s.offset > character_bytes || s.length >= character_bytes - s.offset || data[h.string_bytes + s.offset + s.length] != '\0') {
+				return false;
+			}
+		}
+		auto string_valid = [&](uint32_t index, bool optional) { return index < h.strings.count || (optional && index == none); };
+		for (uint32_t i = 0; i < h.values.count; i++) {
+			const Value& v = section<Value>(h.values)[i];
+			if ((v.type == ValueType::String && !string_valid(v.index, false))
+				|| (v.type == ValueType::Array && !range_valid({ v.index, v.count }, h.values.count))
+				|| (v.type == ValueType::Object && !range_valid({ v.index, v.count }, h.fields.count))
+				|| v.type > ValueType::Object) {
+				return false;
+			}
+		}
+		for (uint32_t i = 0; i < h.fields.count; i++) {
+			const Field& f = section<Field>(h.fields)[i];
+			if (!string_valid(f.name, false) || f.value >= h.values.count) {
+				return false;
+			}
+		}
+		// the cooker writes children after their parent, so a value pointing at or before itself is corrupt (and could
+		// loop); walking backwards, every child's depth is known by the time its parent is reached
+		std::vector<uint32_t> depths(h.values.count, 1);
+		for (uint32_t i = h.values.count; i-- > 0;) {
+			const Value& v = section<Value>(h.values)[i];
+			auto child = [&](uint32_t index) {
+				depths[i] = std::max(depths[i], depths[index] + 1);
+				return index > i;
+			};
+			for (uint32_t c = 0; v.type == ValueType::Array && c < v.count; c++) {
+				if (!child(v.index + c)) {
+					return false;
+				}
+			}
+			for (uint32_t c = 0; v.type == ValueType::Object && c < v.count; c++) {
+				if (!child(section<Field>(h.fields)[v.index + c].value)) {
+					return false;
+				}
+			}
+			if (depths[i] > max_depth) {
+				return false;
+			}
+		}
+		for (uint32_t i = 0; i < h.components.count; i++) {
+			const Component& c = section<Component>(h.components)[i];
+			if (!string_valid(c.key, false) || !string_valid(c.type, false) || !range_valid(c.fields, h.fields.count)) {
+				return false;
+			}
+		}
+		for (uint32_t i = 0; i < h.actors.count; i++) {
+			const Actor& a = section<Actor>(h.actors)[i];
+			if (!string_valid(a.name, true) || !string_valid(a.template_name, true) || !range_valid(a.components, h.components.count)) {
+				return false;
+			}
+		}
+		for (uint32_t i = 0; i < h.dependencies.count; i++) {
+			if (!string_valid(section<uint32_t>(h.dependencies)[i], false)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void close() {
+#ifdef COOKED_USE_MMAP
+		if (mapping != nullptr) {
+			munmap(mapping, size);
+			mapping = nullptr;
+		}
+#endif
+		buffer.clear();
+		data = nullptr;
+		size = 0;
+	}
+
+public:
+	File() = default;
+	File(const File&) = delete;
+	File& operator=(const File&) = delete;
+	~File() {
+		close();
+	}
+
+	// returns false (leaving the file closed) if it is missing, truncated or from another cooker version
+	bool open(const std::string& file_path) {
+		close();
+		path_ = file_path;
+		// the pack does not change while mounted; a loose file can be re-cooked while the engine runs
+		const bool in_pack = ResourceFS::packed(file_path) != nullptr;
+		std::error_code error;
+		stamp_ = in_pack ? 0 : static_cast<int64_t>(std::filesystem::last_write_time(file_path, error).time_since_epoch().count());
+		if (in_pack) {
+			std::optional<ResourceData> packed = ResourceFS::read(file_path);
+			if (!packed.has_value()) {
+				return false;
+			}
+			if (packed->mapped()) {
+				data = packed->bytes().data();
+				size = packed->bytes().size();
+			} else {
+				buffer = packed->take();
+				data = buffer.data();
+				size = buffer.size();
+			}
+			if (!validate()) {
+				close();
+				return false;
+			}
+			return true;
+		}
+#ifdef COOKED_USE_MMAP
+		int fd = ::open(file_path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) == 0 && info.st_size > 0) {
+			void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapped != MAP_FAILED) {
+				mapping = mapped;
+				data = static_cast<const char*>(mapped);
+				size = static_cast<size_t>(info.st_size);
+			}
+		}
+		::close(fd);
+		if (mapping == nullptr) {
+			return false;
+		}
+#else
+		std::ifstream file(file_path, std::ios::binary);
+		if (!file) {
+			return false;
+		}
+		buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		data = buffer.data();
+		size = buffer.size();
+#endif
+		if (!validate()) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	const std::string& path() const {
+		return path_;
+	}
+
+	// the modification time of a loose file when it was opened, 0 inside the pack
+	int64_t stamp() const {
+		return stamp_;
+	}
+
+	const Header& header() const {
+		return *reinterpret_cast<const Header*>(data);
+	}
+
+	// returns an empty view for none
+	std::string_view string(uint32_t index) const {
+		if (index == none) {
+			return {};
+		}
+		const String& s = section<String>(header().strings)[index];
+		return { data + header().string_bytes + s.offset, s.length };
+	}
+
+	const char* c_str(uint32_t index) const {
+		return data + header().string_bytes + section<String>(header().strings)[index].offset;
+	}
+
+	const Value& value(uint32_t index) const {
+		return section<Value>(header().values)[index];
+	}
+
+	const Field& field(uint32_t index) const {
+		return section<Field>(header().fields)[index];
+	}
+
+	const Component& component(uint32_t index) const {
+		return section<Component>(header().components)[index];
+	}
+
+	const Actor& actor(uint32_t index) const {
+		return section<Actor>(header().actors)[index];
+	}
+
+	uint32_t actor_count() const {
+		return header().actors.count;
+	}
+
+	std::string_view dependency(uint32_t index) const {
+		return string(section<uint32_t>(header().dependencies)[index]);
+	}
+
+	uint32_t dependency_count() const {
+		return header().dependencies.count;
+	}
+};
+
+}
@@ -0,0 +1,332 @@
+// Offline cooker: compiles resources/scenes/*.scene and resources/actor_templates/*.template into the binary
+// .scenec/.templatec format described in cooked.h. The engine prefers a cooked file unless its JSON source, or for a
+// scene one of the templates it embeds, is newer.
+//
+// usage: cooker <path to resources/>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "rapidjson/document.h"
+#include "rapidjson/error/en.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include "cooked.h"
+
+static bool read_json(const std::filesystem::path& path, rapidjson::Document& doc) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		std::cout << "error: could not open " << path.string() << std::endl;
+		return false;
+	}
+	std::string text{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+	doc.Parse(text.c_str());
+	if (doc.HasParseError()) {
+		std::cout << "error: " << path.string() << " offset " << doc.GetErrorOffset() << ": " << rapidjson::GetParseError_En(doc.GetParseError()) << std::endl;
+		return false;
+	}
+	return true;
+}
+
+static std::string serialize(const rapidjson::Value& value) {
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	value.Accept(writer);
+	return buffer.GetString();
+}
+
+class CookedWriter {
+	std::vector<cooked::String> strings;
+	std::string characters;
+	std::unordered_map<std::string, uint32_t> interned;
+	std::vector<cooked::Value> values;
+	std::vector<cooked::Field> fields;
+	std::unordered_map<std::string, cooked::Section> field_blocks;
+
+	void fill_value(uint32_t slot, const rapidjson::Value& json) {
+		cooked::Value value{};
+		// mirrors the engine's JSON conversion, numbers that are not 32 bit ints go through float
+		if (json.IsArray()) {
+			uint32_t first = static_cast<uint32_t>(values.size());
+			values.resize(values.size() + json.Size());
+			for (rapidjson::SizeType i = 0; i < json.Size(); i++) {
+				fill_value(first + i, json[i]);
+			}
+			value.type = cooked::ValueType::Array;
+			value.count = json.Size();
+			value.index = first;
+		} else if (json.IsBool()) {
+			value.type = cooked::ValueType::Bool;
+			value.boolean = json.GetBool();
+		} else if (json.IsInt()) {
+			value.type = cooked::ValueType::Int;
+			value.integer = json.GetInt();
+		} else if (json.IsNumber()) {
+			value.type = cooked::ValueType::Number;
+			value.number = static_cast<double>(json.Get<float>());
+		} else if (json.IsObject()) {
+			cooked::Section members = add_members(json, false);
+			value.type = cooked::ValueType::Object;
+			value.count = members.count;
+			value.index = members.offset;
+		} else if (json.IsString()) {
+			value.type = cooked::ValueType::String;
+			value.index = intern(json.GetString());
+		} else {
+			value.type = cooked::ValueType::Nil;
+		}
+		values[slot] = value;
+	}
+
+	cooked::Section add_members(const rapidjson::Value& object, bool skip_type) {
+		uint32_t count = 0;
+		for (auto it = object.MemberBegin(); it != object.MemberEnd(); it++) {
+			count += static_cast<uint32_t>(!skip_type || std::string_view{ it->name.GetString() } != "type");
+		}
+		uint32_t first = static_cast<uint32_t>(fields.size());
+		fields.resize(fields.size() + count);
+		uint32_t i = first;
+		for (auto it = object.MemberBegin(); it != object.MemberEnd(); it++) {
+			if (skip_type && std::string_view{ it->name.GetString() } == "type") {
+				continue;
+			}
+			uint32_t slot = static_cast<uint32_t>(values.size());
+			values.emplace_back();
+			fill_value(slot, it->value);
+			fields[i++] = { intern(it->name.GetString()), slot };
+		}
+		return { first, count };
+	}
+
+public:
+	std::vector<cooked::Component> components;
+	std::vector<cooked::Actor> actors;
+	std::vector<uint32_t> dependencies;
+	uint32_t preload = cooked::none;
+
+	uint32_t add_value(const rapidjson::Value& json) {
+		uint32_t slot = static_cast<uint32_t>(values.size());
+		values.emplace_back();
+		fill_value(slot, json);
+		return slot;
+	}
+
+	uint32_t intern(std::string_view string) {
+		auto [it, inserted] = interned.try_emplace(std::string(string), static_cast<uint32_t>(strings.size()));
+		if (inserted) {
+			strings.push_back({ static_cast<uint32_t>(characters.size()), static_cast<uint32_t>(string.size()) });
+			characters.append(string);
+			characters.push_back('\0');
+		}
+		return it->second;
+	}
+
+	// a component's fields without "type"; identical override objects share one range
+	cooked::Section add_component_fields(const rapidjson::Value* object) {
+		if (object == nullptr || !object->IsObject()) {
+			return { 0, 0 };
+		}
+		std::string id = serialize(*object);
+		auto found = field_blocks.find(id);
+		if (found != field_blocks.end()) {
+			return found->second;
+		}
+		cooked::Section members = add_members(*object, true);
+		field_blocks.insert({ std::move(id), members });
+		return members;
+	}
+
+	bool write(const std::filesystem::path& path, cooked::Kind kind) const {
+		auto align = [](size_t offset) { return (offset + 7) & ~size_t{ 7 }; };
+		cooked::Header header{};
+		std::memcpy(header.magic, cooked::magic, sizeof(cooked::magic));
+		header.version = cooked::version;
+		header.kind = kind;
+		header.preload = preload;
+		size_t offset = align(sizeof(cooked::Header));
+		auto place = [&](cooked::Section& section, size_t count, size_t element_size) {
+			section = { static_cast<uint32_t>(offset), static_cast<uint32_t>(count) };
+			offset = align(offset + count * element_size);
+		};
+		place(header.strings, strings.size(), sizeof(cooked::String));
+		place(header.values, values.size(), sizeof(cooked::Value));
+		place(header.fields, fields.size(), sizeof(cooked::Field));
+		place(header.components, components.size(), sizeof(cooked::Component));
+		place(header.actors, actors.size(), sizeof(cooked::Actor));
+		place(header.dependencies, dependencies.size(), sizeof(uint32_t));
+		header.string_bytes = static_cast<uint32_t>(offset);
+
+		std::string out(offset + characters.size(), '\0');
+		auto copy = [&](const cooked::Section& section, const void* source, size_t element_size) {
+			if (section.count != 0) {
+				std::memcpy(out.data() + section.offset, source, section.count * element_size);
+			}
+		};
+		std::memcpy(out.data(), &header, sizeof(header));
+		copy(header.strings, strings.data(), sizeof(cooked::String));
+		copy(header.values, values.data(), sizeof(cooked::Value));
+		copy(header.fields, fields.data(), sizeof(cooked::Field));
+		copy(header.components, components.data(), sizeof(cooked::Component));
+		copy(header.actors, actors.data(), sizeof(cooked::Actor));
+		copy(header.dependencies, dependencies.data(), sizeof(uint32_t));
+		std::memcpy(out.data() + offset, characters.data(), characters.size());
+
+		std::ofstream file(path, std::ios::binary);
+		file.write(out.data(), static_cast<std::streamsize>(out.size()));
+		return static_cast<bool>(file);
+	}
+};
+
+class Cooker {
+	std::filesystem::path resources;
+	std::map<std::string, rapidjson::Document> templates;
+
+	const rapidjson::Document* load_template(const std::string& name) {
+		auto found = templates.find(name);
+		if (found != templates.end()) {
+			return &found->second;
+		}
+		rapidjson::Document doc;
+		if (!read_json(resources / "actor_templates" / (name + ".template"), doc)) {
+			return nullptr;
+		}
+		return &templates.emplace(name, std::move(doc)).first->second;
+	}
+
+public:
+	Cooker(std::filesystem::path resources) : resources(std::move(resources)) {}
+
+	bool cook_template(const std::filesystem::path& path) {
+		rapidjson::Document doc;
+		if (!read_json(path, doc)) {
+			return false;
+		}
+		CookedWriter writer;
+		cooked::Actor actor{ doc.HasMember("name") ? writer.intern(doc["name"].GetString()) : cooked::none, cooked::none, { 0, 0 } };
+		if (doc.HasMember("components")) {
+			const auto& components = doc["components"];
+			std::vector<std::string> keys;
+			for (auto it = components.MemberBegin(); it != components.MemberEnd(); it++) {
+				keys.push_back(it->name.GetString());
+			}
+			std::sort(keys.begin(), keys.end());
+			actor.components = { static_cast<uint32_t>(writer.components.size()), static_cast<uint32_t>(keys.size()) };
+			for (const auto& key : keys) {
+				const auto& component = components[key.c_str()];
+				if (!component.HasMember("type")) {
+					std::cout << "error: " << path.string() << ": component " << key << " has no type" << std::endl;
+					return false;
+				}
+				writer.components.push_back({ writer.intern(key), writer.intern(component["type"].GetString()), 0, writer.add_component_fields(&component) });
+			}
+		}
+		writer.actors.push_back(actor);
+		return writer.write(path.string() + "c", cooked::Kind::Template);
+	}
+
+	bool cook_scene(const std::filesystem::path& path) {
+		rapidjson::Document doc;
+		if (!read_json(path, doc)) {
+			return false;
+		}
+		if (!doc.HasMember("actors") || !doc["actors"].IsArray()) {
+			std::cout << "error: " << path.string() << " has no actors array" << std::endl;
+			return false;
+		}
+		CookedWriter writer;
+		if (doc.HasMember("preload") && doc["preload"].IsObject()) {
+			writer.preload = writer.add_value(doc["preload"]);
+		}
+		for (const auto& actor_json : doc["actors"].GetArray()) {
+			std::string template_name = actor_json.HasMember("template") ? actor_json["template"].GetString() : "";
+			const rapidjson::Value* template_components = nullptr;
+			cooked::Actor actor{ cooked::none, cooked::none, { 0, 0 } };
+			if (!template_name.empty()) {
+				const rapidjson::Document* templ = load_template(template_name);
+				if (templ == nullptr) {
+					return false;
+				}
+				actor.template_name = writer.intern(template_name);
+				// the engine checks these against the cooked file's age, since their contents are baked in
+				if (std::find(writer.dependencies.begin(), writer.dependencies.end(), actor.template_name) == writer.dependencies.end()) {
+					writer.dependencies.push_back(actor.template_name);
+				}
+				if (templ->HasMember("name")) {
+					actor.name = writer.intern((*templ)["name"].GetString());
+				}
+				if (templ->HasMember("components")) {
+					template_components = &(*templ)["components"];
+				}
+			}
+			if (actor_json.HasMember("name")) {
+				actor.name = writer.intern(actor_json["name"].GetString());
+			}
+
+			const rapidjson::Value* components = actor_json.HasMember("components") ? &actor_json["components"] : nullptr;
+			std::vector<std::string> keys;
+			if (components != nullptr) {
+				for (auto it = components->MemberBegin(); it != components->MemberEnd(); it++) {
+					keys.push_back(it->name.GetString());
+				}
+			}
+			if (template_components != nullptr) {
+				for (auto it = template_components->MemberBegin(); it != template_components->MemberEnd(); it++) {
+					if (components == nullptr || !components->HasMember(it->name)) {
+						keys.push_back(it->name.GetString());
+					}
+				}
+			}
+			std::sort(keys.begin(), keys.end());
+
+			actor.components = { static_cast<uint32_t>(writer.components.size()), static_cast<uint32_t>(keys.size()) };
+			for (const auto& key : keys) {
+				const rapidjson::Value* overrides = components && components->HasMember(key.c_str()) ? &(*components)[key.c_str()] : nullptr;
+				cooked::Component component{ writer.intern(key), cooked::none, 0, writer.add_component_fields(overrides) };
+				if (template_components != nullptr && template_components->HasMember(key.c_str())) {
+					component.flags |= cooked::FromTemplate;
+					component.type = writer.intern((*template_components)[key.c_str()]["type"].GetString());
+				} else if (overrides != nullptr && overrides->HasMember("type")) {
+					component.type = writer.intern((*overrides)["type"].GetString());
+				} else {
+					std::cout << "error: " << path.string() << ": component " << key << " has no type" << std::endl;
+					return false;
+				}
+				writer.components.push_back(component);
+			}
+			writer.actors.push_back(actor);
+		}
+		return writer.write(path.string() + "c", cooked::Kind::Scene);
+	}
+};
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::cout << "usage: cooker <path to resources/>" << std::endl;
+		return 1;
+	}
+	const std::filesystem::path resources = argv[1];
+	Cooker cooker(resources);
+	int failures = 0;
+	std::error_code error;
+	for (const auto& [directory, extension, is_scene] : { std::tuple{ "actor_templates", ".template", false }, std::tuple{ "scenes", ".scene", true } }) {
+		for (const auto& entry : std::filesystem::directory_iterator(resources / directory, error)) {
+			if (entry.path().extension() != extension) {
+				continue;
+			}
+			bool cooked = is_scene ? cooker.cook_scene(entry.path()) : cooker.cook_template(entry.path());
+			if (cooked) {
+				std::cout << "Cooked " << entry.path().string() << "c" << std::endl;
+			} else {
+				failures += 1;
+			}
+		}
+	}
+	return failures;
+}
@@ -50,6 +50,23 @@ local actor_type = {
     end,
 
     RemoveComponent = function(actor, component_ref)
+    end,
+
+    -- disabled components are dropped from OnUpdate/OnLateUpdate dispatch; `component.enabled = false` does the same.
+    -- reading component.enabled on an attached component returns the same live state as IsEnabled
+    SetEnabled = function(actor, component_ref, enabled)
+    end,
+
+    IsEnabled = function(actor, component_ref)
+        return true
+    end,
+
+    -- inactive actors are skipped by the update loop entirely; reactivation takes effect the next frame
+    SetActive = function(actor, active)
+    end,
+
+    IsActive = function(actor)
+        return true
     end
 }
 
@@ -168,6 +185,7 @@ Model = {
     enabled = false,
     type = "",
     mesh = "",
+    static = false, -- instances that never move; drawn from a buffer that is only uploaded when static instances change
     transform = Transform,
     translation = vec3, -- alias for transform.translation, will update the transform if modified
     translation_x = 0, -- alias for translation.translation.x, will update the transform if modified
@@ -190,6 +208,12 @@ Model = {
 
     OnDestroy = function(model)
     end,
+
+    SetTransforms = function(models, transforms) -- sets models[i].transform = transforms[i] for every model in one call
+    end,
+
+    SetTranslations = function(models, positions) -- positions is an array of vec3 or a flat array of x, y, z numbers
+    end,
 }
 
 Actor = {
@@ -201,6 +225,20 @@ Actor = {
         return {}
     end,
 
+    FindAllWithComponent = function(type) -- every component of the type, in the order they were added
+        return {}
+    end,
+
+    EachWithComponent = function(type) -- for component, actor in Actor.EachWithComponent(type) do ... end
+        return function()
+            return nil, nil
+        end
+    end,
+
+    FindAllWithComponents = function(types) -- actors with a component of every type in the array
+        return {}
+    end,
+
     Instantiate = function(prefab)
         return actor_type
     end,
@@ -258,14 +296,54 @@ Scene = {
     Load = function(scene)
     end,
 
+    -- keeps the current scene running while the new one is read and its meshes decoded in the background,
+    -- then creates its actors over several frames and publishes "SceneLoaded" with the scene name
+    LoadAsync = function(scene)
+    end,
+
+    GetLoadProgress = function() -- 0 to 1, 1 when no load is in progress
+        return 1
+    end,
+
     GetCurrent = function()
         return ""
     end,
 
+    -- captures every live actor and its components' state; returns a handle for Restore. Raises an error if a
+    -- component field holds a function or another value that cannot be saved
+    Snapshot = function()
+        return 0
+    end,
+
+    -- at the start of the next frame, replaces every actor with the snapshot's, without calling OnStart again
+    Restore = function(handle)
+    end,
+
+    DiscardSnapshot = function(handle)
+    end,
+
     DontDestroy = function(actor)
     end
 }
 
+-- engine work spread over frames: OnStart of new actors and added components, first uploads of meshes, audio decoding
+Work = {
+    -- runs the actor's pending OnStart and AddComponent calls next frame regardless of the work budget
+    Expedite = function(actor)
+    end,
+
+    ExpediteMesh = function(mesh)
+    end,
+
+    -- runs all pending work next frame
+    Flush = function()
+    end,
+
+    GetPending = function()
+        return 0
+    end
+}
+
 Event = {
     Publish = function(event, ...)
     end,
@@ -277,6 +355,26 @@ Event = {
     end
 }
 
+-- coroutines run until they yield one of the Wait* conditions, yielding nothing waits one frame
+-- components can also call self:StartCoroutine(fn); coroutines stop when their actor or component is destroyed
+Coroutine = {
+    Start = function(component, fn) -- fn is called with component, returns an id
+        return 0
+    end,
+
+    Stop = function(id)
+    end,
+
+    WaitFrames = function(frames) -- coroutine.yield(Coroutine.WaitFrames(n))
+    end,
+
+    WaitSeconds = function(seconds)
+    end,
+
+    WaitEvent = function(event) -- resumes on the next Event.Publish of event
+    end
+}
+
 Math = {
     Random = function(min, max)
         return 0
@@ -292,5 +390,12 @@ Math = {
 }
 
 Camera = {
-    transform = Transform.identity()
+    transform = Transform.identity(),
+    visible_instances = 0, -- read only; instances drawn last frame
+    culled_instances = 0, -- read only; instances frustum or size culled last frame
+    draw_calls = 0, -- read only; draw calls issued last frame
+    state_changes = 0, -- read only; pipeline, bind group and buffer bindings issued last frame
+    skipped_state_changes = 0, -- read only; bindings dropped last frame because they were already bound
+    bundle_hits = 0, -- read only; render bundles replayed unchanged last frame
+    bundle_misses = 0, -- read only; render bundles recorded, or draws encoded without one, last frame
 }
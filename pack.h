@@ -0,0 +1,466 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PACK_USE_MMAP
+#endif
+
+// Resource packs (resources.pack) written by the packer: every file under webgpu_resources/ in one archive, addressed by
+// its path relative to webgpu_resources/. The index is sorted by path hash, so a lookup is a binary search in the mapped
+// index. Entries may be LZ4 block compressed; uncompressed entries are read straight out of the mapping.
+namespace pack {
+
+constexpr char magic[4] = { 'M', 'R', 'P', 'K' };
+constexpr uint32_t version = 1;
+
+enum EntryFlags : uint32_t {
+	Lz4 = 1,
+};
+
+struct Header {
+	char magic[4];
+	uint32_t version;
+	uint32_t entry_count;
+	uint32_t names_size;
+	uint64_t index_offset; // entry_count entries, then names_size bytes of names
+	uint64_t file_size;
+};
+
+struct Entry {
+	uint64_t hash;
+	uint64_t offset;
+	uint32_t stored_size;
+	uint32_t size;
+	uint32_t name_offset;
+	uint32_t name_length;
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+static_assert(sizeof(Header) == 32 && sizeof(Entry) == 40);
+
+inline uint64_t hash_path(std::string_view path) {
+	uint64_t hash = 14695981039346656037ull;
+	for (char c : path) {
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md), greedy single probe matcher
+inline std::string lz4_compress(std::string_view input) {
+	constexpr int hash_bits = 16;
+	constexpr size_t min_match = 4;
+	const size_t n = input.size();
+	std::string out;
+	out.reserve(n + n / 255 + 16);
+	auto read32 = [&](size_t i) {
+		uint32_t value;
+		std::memcpy(&value, input.data() + i, sizeof(value));
+		return value;
+	};
+	auto put_length = [&](size_t length) {
+		for (; length >= 255; length -= 255) {
+			out.push_back(static_cast<char>(255));
+		}
+		out.push_back(static_cast<char>(length));
+	};
+	auto emit = [&](size_t literal_start, size_t literal_length, size_t offset, size_t match_length) {
+		size_t match_code = match_length == 0 ? 0 : match_length - min_match;
+		out.push_back(static_cast<char>((std::min<size_t>(literal_length, 15) << 4) | std::min<size_t>(match_code, 15)));
+		if (literal_length >= 15) {
+			put_length(literal_length - 15);
+		}
+		out.append(input.substr(literal_start, literal_length));
+		if (match_length == 0) {
+			return;
+		}
+		out.push_back(static_cast<char>(offset & 0xff));
+		out.push_back(static_cast<char>(offset >> 8));
+		if (match_code >= 15) {
+			put_length(match_code - 15);
+		}
+	};
+
+	size_t anchor = 0;
+	// the format requires the last match to start 12 bytes and end 5 bytes before the end of the block
+	if (n > 12) {
+		std::vector<int64_t> table(size_t{ 1 } << hash_bits, -1);
+		const size_t match_limit = n - 12;
+		const size_t end_limit = n - 5;
+		size_t i = 0;
+		while (i < match_limit) {
+			uint32_t sequence = read32(i);
+			uint32_t slot = (sequence * 2654435761u) >> (32 - hash_bits);
+			int64_t candidate = table[slot];
+			table[slot] = static_cast<int64_t>(i);
+			if (candidate < 0 || i - static_cast<size_t>(candidate) > 65535 || read32(static_cast<size_t>(candidate)) != sequence) {
+				i++;
+				continue;
+			}
+			size_t match = static_cast<size_t>(candidate);
+			size_t length = min_match;
+			while (i + length < end_limit && input[match + length] == input[i + length]) {
+				length++;
+			}
+			emit(anchor, i - anchor, i - match, length);
+			i += length;
+			anchor = i;
+		}
+	}
+	emit(anchor, n - anchor, 0, 0);
+	return out;
+}
+
+// returns false on malformed input or if it does not decode to exactly size bytes
+inline bool lz4_decompress(std::string_view input, char* out, size_t size) {
+	const uint8_t* in = reinterpret_cast<const uint8_t*>(input.data());
+	const uint8_t* end = in + input.size();
+	size_t written = 0;
+	auto get_length = [&](size_t& length) {
+		uint8_t byte;
+		do {
+			if (in == end) {
+				return false;
+			}
+			byte = *in++;
+			length += byte;
+		} while (byte == 255);
+		return true;
+	};
+	while (in < end) {
+		uint8_t token = *in++;
+		size_t literals = token >> 4;
+		if (literals == 15 && !get_length(literals)) {
+			return false;
+		}
+		if (literals > static_cast<size_t>(end - in) || literals > size - written) {
+			return false;
+		}
+		std::memcpy(out + written, in, literals);
+		in += literals;
+		written += literals;
+		if (in == end) {
+			break;
+		}
+		if (end - in < 2) {
+			return false;
+		}
+		size_t offset = in[0] | (static_cast<size_t>(in[1]) << 8);
+		in += 2;
+		size_t length = token & 15;
+		if (length == 15 && !get_length(length)) {
+			return false;
+		}
+		length += 4;
+		if (offset == 0 || offset > written || length > size - written) {
+			return false;
+		}
+		// matches may overlap their own output, so copy forwards byte by byte
+		for (size_t i = 0; i < length; i++) {
+			out[written + i] = out[written - offset + i];
+		}
+		written += length;
+	}
+	return written == size;
+}
+
+// A pack opened read-only. Where mmap is unavailable only the index is read into memory and entries are read on demand.
+class Archive {
+	std::string index_buffer;
+	const Entry* entries = nullptr;
+	const char* names = nullptr;
+	uint32_t entry_count = 0;
+	uint32_t names_size = 0;
+	uint64_t file_size = 0;
+#ifdef PACK_USE_MMAP
+	const char* data = nullptr;
+	void* mapping = nullptr;
+#else
+	mutable std::mutex file_mutex;
+	mutable std::ifstream file;
+#endif
+
+	bool validate(const Header& header) const {
+		return std::memcmp(header.magic, magic, sizeof(magic)) == 0 && header.version == version && header.file_size == file_size
+			&& header.index_offset % alignof(Entry) == 0 && header.index_offset <= file_size
+			&& (file_size - header.index_offset) / sizeof(Entry) >= header.entry_count
+			&& file_size - header.index_offset - header.entry_count * sizeof(Entry) >= header.names_size;
+	}
+
+	bool validate_entries() const {
+		for (uint32_t i = 0; i < entry_count; i++) {
+			const Entry& entry = entries[i];
+			if (entry.offset > file_size || entry.stored_size > file_size - entry.offset
+				|| entry.name_offset > names_size || entry.name_length > names_size - entry.name_offset
+				|| (i > 0 && entries[i - 1].hash > entry.hash)
+				|| ((entry.flags & Lz4) == 0 && entry.stored_size != entry.size)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void close() {
+#ifdef PACK_USE_MMAP
+		if (mapping != nullptr) {
+			munmap(mapping, file_size);
+			mapping = nullptr;
+		}
+		data = nullptr;
+#else
+		file.close();
+#endif
+		index_buffer.clear();
+		entries = nullptr;
+		names = nullptr;
+		entry_count = 0;
+		names_size = 0;
+		file_size = 0;
+	}
+
+public:
+	Archive() = default;
+	Archive(const Archive&) = delete;
+	Archive& operator=(const Archive&) = delete;
+	~Archive() {
+		close();
+	}
+
+	// returns false (leaving the archive closed) if the file is missing, truncated or from another packer version
+	bool open(const std::string& path) {
+		close();
+		Header header;
+#ifdef PACK_USE_MMAP
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			return false;
+		}
+		struct stat info;
+		if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= sizeof(Header)) {
+			void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapped != MAP_FAILED) {
+				mapping = mapped;
+				data = static_cast<const char*>(mapped);
+				file_size = static_cast<uint64_t>(info.st_size);
+			}
+		}
+		::close(fd);
+		if (mapping == nullptr) {
+			return false;
+		}
+		std::memcpy(&header, data, sizeof(header));
+		if (!validate(header)) {
+			close();
+			return false;
+		}
+		entries = reinterpret_cast<const Entry*>(data + header.index_offset);
+		names = data + header.index_offset + header.entry_count * sizeof(Entry);
+#else
+		file.open(path, std::ios::binary);
+		if (!file) {
+			return false;
+		}
+		file.seekg(0, std::ios::end);
+		file_size = static_cast<uint64_t>(file.tellg());
+		file.seekg(0);
+		if (file_size < sizeof(Header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header)) || !validate(header)) {
+			close();
+			return false;
+		}
+		// only the index and names are kept in memory
+		index_buffer.resize(header.entry_count * sizeof(Entry) + header.names_size);
+		file.seekg(static_cast<std::streamoff>(header.index_offset));
+		if (!file.read(index_buffer.data(), static_cast<std::streamsize>(index_buffer.size()))) {
+			close();
+			return false;
+		}
+		entries = reinterpret_cast<const Entry*>(index_buffer.data());
+		names = index_buffer.data() + header.entry_count * sizeof(Entry);
+#endif
+		entry_count = header.entry_count;
+		names_size = header.names_size;
+		if (!validate_entries()) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	bool is_open() const {
+		return entries != nullptr;
+	}
+
+	const Entry* find(std::string_view name) const {
+		uint64_t hash = hash_path(name);
+		const Entry* end = entries + entry_count;
+		for (const Entry* it = std::lower_bound(entries, end, hash, [](const Entry& e, uint64_t h) { return e.hash < h; }); it != end && it->hash == hash; it++) {
+			if (this->name(*it) == name) {
+				return it;
+			}
+		}
+		return nullptr;
+	}
+
+	std::string_view name(const Entry& entry) const {
+		return { names + entry.name_offset, entry.name_length };
+	}
+
+	// the entry's bytes inside the mapping, or an empty view when it is compressed or the pack is not mapped
+	std::string_view mapped(const Entry& entry) const {
+#ifdef PACK_USE_MMAP
+		if ((entry.flags & Lz4) == 0) {
+			return { data + entry.offset, entry.size };
+		}
+#endif
+		return {};
+	}
+
+	// copies (and decompresses) the entry into out
+	bool read(const Entry& entry, std::string& out) const {
+		std::string stored_copy;
+		std::string_view stored;
+#ifdef PACK_USE_MMAP
+		stored = { data + entry.offset, entry.stored_size };
+#else
+		{
+			std::lock_guard<std::mutex> lock(file_mutex);
+			stored_copy.resize(entry.stored_size);
+			file.seekg(static_cast<std::streamoff>(entry.offset));
+			if (!file.read(stored_copy.data(), static_cast<std::streamsize>(stored_copy.size()))) {
+				file.clear();
+				return false;
+			}
+		}
+		if ((entry.flags & Lz4) == 0) {
+			out = std::move(stored_copy);
+			return true;
+		}
+		stored = stored_copy;
+#endif
+		if ((entry.flags & Lz4) == 0) {
+			out.assign(stored);
+			return true;
+		}
+		out.resize(entry.size);
+		return lz4_decompress(stored, out.data(), out.size());
+	}
+};
+
+}
+
+// bytes of one resource: a view into the mapped pack when possible, otherwise an owned copy
+class ResourceData {
+	std::string owned;
+	std::string_view view;
+	bool is_mapped;
+public:
+	explicit ResourceData(std::string_view mapped) : view(mapped), is_mapped(true) {}
+	explicit ResourceData(std::string bytes) : owned(std::move(bytes)), is_mapped(false) {}
+
+	std::span<const char> bytes() const {
+		return is_mapped ? std::span<const char>(view.data(), view.size()) : std::span<const char>(owned.data(), owned.size());
+	}
+
+	bool mapped() const {
+		return is_mapped;
+	}
+
+	std::string take() {
+		return is_mapped ? std::string(view) : std::move(owned);
+	}
+};
+
+// Every resource read goes through here. Paths are the engine's usual ones (base_path + "resources/..."); with a pack
+// mounted they are looked up in it, and anything the pack lacks (such as cache/) falls back to the disk. With the loose
+// overlay on, a file on disk wins over its packed copy, so assets can be edited without rebuilding the pack.
+class ResourceFS {
+	static inline pack::Archive archive;
+	static inline std::string root;
+	static inline bool overlay = false;
+
+	static std::string_view relative(std::string_view path) {
+		if (path.substr(0, root.size()) == root) {
+			path.remove_prefix(root.size());
+		}
+		return path;
+	}
+
+public:
+	static bool mount(const std::string& pack_path, std::string pack_root, bool loose_overlay) {
+		root = std::move(pack_root);
+		overlay = loose_overlay;
+		return archive.open(pack_path);
+	}
+
+	static bool mounted() {
+		return archive.is_open();
+	}
+
+	// the pack entry a read of path is served from, or nullptr if it comes from the disk
+	static const pack::Entry* packed(const std::string& path) {
+		if (!archive.is_open()) {
+			return nullptr;
+		}
+		const pack::Entry* entry = archive.find(relative(path));
+		if (entry == nullptr) {
+			return nullptr;
+		}
+		std::error_code error;
+		if (overlay && std::filesystem::exists(path, error)) {
+			return nullptr;
+		}
+		return entry;
+	}
+
+	static bool exists(const std::string& path) {
+		std::error_code error;
+		return packed(path) != nullptr || std::filesystem::exists(path, error);
+	}
+
+	// the uncompressed size of path without reading it
+	static std::optional<size_t> file_size(const std::string& path) {
+		if (const pack::Entry* entry = packed(path)) {
+			return entry->size;
+		}
+		std::error_code error;
+		uintmax_t size = std::filesystem::file_size(path, error);
+		if (error) {
+			return {};
+		}
+		return static_cast<size_t>(size);
+	}
+
+	static std::optional<ResourceData> read(const std::string& path) {
+		if (const pack::Entry* entry = packed(path)) {
+			std::string_view mapped = archive.mapped(*entry);
+			if (mapped.data() != nullptr) {
+				return ResourceData(mapped);
+			}
+			std::string bytes;
+			if (!archive.read(*entry, bytes)) {
+				return {};
+			}
+			return ResourceData(std::move(bytes));
+		}
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			return {};
+		}
+		return ResourceData(std::string{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() });
+	}
+};
@@ -0,0 +1,99 @@
+// Offline packer: bundles every file under webgpu_resources/ (except cache/ and old packs) into resources.pack, the
+// archive described in pack.h. Run it after the cooker so cooked scenes and templates go in too.
+//
+// usage: packer <path to webgpu_resources/> [--store]
+//   --store  skip LZ4 compression
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "pack.h"
+
+struct PackedFile {
+	std::string name;
+	std::string stored;
+	pack::Entry entry;
+};
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::cout << "usage: packer <path to webgpu_resources/> [--store]" << std::endl;
+		return 1;
+	}
+	const std::filesystem::path root = argv[1];
+	const bool compress = !(argc > 2 && std::string_view{ argv[2] } == "--store");
+	const std::filesystem::path output = root / "resources.pack";
+
+	std::vector<PackedFile> files;
+	std::error_code error;
+	for (auto it = std::filesystem::recursive_directory_iterator(root, error); it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+		const std::filesystem::path relative = it->path().lexically_relative(root);
+		if (it->is_directory() && relative == "cache") {
+			it.disable_recursion_pending();
+			continue;
+		}
+		if (!it->is_regular_file() || it->path().extension() == ".pack") {
+			continue;
+		}
+		std::ifstream file(it->path(), std::ios::binary);
+		std::string bytes{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+		if (bytes.size() > UINT32_MAX) {
+			std::cout << "error: " << it->path().string() << " is too large to pack" << std::endl;
+			return 1;
+		}
+		PackedFile packed{ relative.generic_string(), {}, {} };
+		packed.entry.hash = pack::hash_path(packed.name);
+		packed.entry.size = static_cast<uint32_t>(bytes.size());
+		std::string compressed = compress ? pack::lz4_compress(bytes) : std::string{};
+		// keep the raw bytes unless compression saves at least an eighth, so they can be read straight out of the mapping
+		if (compress && compressed.size() < bytes.size() - bytes.size() / 8) {
+			packed.stored = std::move(compressed);
+			packed.entry.flags = pack::Lz4;
+		} else {
+			packed.stored = std::move(bytes);
+		}
+		packed.entry.stored_size = static_cast<uint32_t>(packed.stored.size());
+		files.push_back(std::move(packed));
+	}
+	std::sort(files.begin(), files.end(), [](const PackedFile& a, const PackedFile& b) {
+		return a.entry.hash != b.entry.hash ? a.entry.hash < b.entry.hash : a.name < b.name;
+	});
+
+	auto align = [](uint64_t offset) { return (offset + 7) & ~uint64_t{ 7 }; };
+	std::string names;
+	uint64_t offset = sizeof(pack::Header);
+	for (auto& file : files) {
+		file.entry.offset = offset;
+		offset = align(offset + file.entry.stored_size);
+		file.entry.name_offset = static_cast<uint32_t>(names.size());
+		file.entry.name_length = static_cast<uint32_t>(file.name.size());
+		names += file.name;
+	}
+	pack::Header header{};
+	std::memcpy(header.magic, pack::magic, sizeof(pack::magic));
+	header.version = pack::version;
+	header.entry_count = static_cast<uint32_t>(files.size());
+	header.names_size = static_cast<uint32_t>(names.size());
+	header.index_offset = offset;
+	header.file_size = offset + files.size() * sizeof(pack::Entry) + names.size();
+
+	std::string out(header.file_size, '\0');
+	std::memcpy(out.data(), &header, sizeof(header));
+	for (size_t i = 0; i < files.size(); i++) {
+		std::memcpy(out.data() + files[i].entry.offset, files[i].stored.data(), files[i].stored.size());
+		std::memcpy(out.data() + header.index_offset + i * sizeof(pack::Entry), &files[i].entry, sizeof(pack::Entry));
+	}
+	std::memcpy(out.data() + header.index_offset + files.size() * sizeof(pack::Entry), names.data(), names.size());
+
+	std::ofstream file(output, std::ios::binary);
+	file.write(out.data(), static_cast<std::streamsize>(out.size()));
+	if (!file) {
+		std::cout << "error: could not write " << output.string() << std::endl;
+		return 1;
+	}
+	std::cout << "Packed " << files.size() << " files into " << output.string() << " (" << out.size() << " bytes)" << std::endl;
+	return 0;
+}
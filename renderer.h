@@ -6,8 +6,12 @@
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <map>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <bit>
 #include "webgpu/webgpu.h"
 #include "sdl2webgpu.h"
 #include "SDL.h"
@@ -28,6 +32,8 @@
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "tiny_gltf.h"
+#include "pack.h"
+#include "transform_kernel.h"
 #if __EMSCRIPTEN__
 #include <emscripten.h>
 #endif
@@ -44,6 +50,8 @@ HOLDER(Surface);
 HOLDER(TextureView);
 HOLDER(CommandEncoder);
 HOLDER(RenderPassEncoder);
+HOLDER(RenderBundleEncoder);
+HOLDER(RenderBundle);
 HOLDER(CommandBuffer);
 HOLDER(RenderPipeline);
 HOLDER(ShaderModule);
@@ -86,19 +94,45 @@ constexpr const char* base_path = "webgpu_resources/";
 #endif
 
 std::string get_file_contents(const char *filename) {
-    std::FILE *fp = fopen((std::string(base_path) + filename).c_str(), "rb");
-    if (!fp) {
+    std::optional<ResourceData> contents = ResourceFS::read(std::string(base_path) + filename);
+    if (!contents.has_value()) {
         std::cout << "Could not open file: " << filename << std::endl;
         std::perror("Error: ");
         throw(errno);
     }
-    std::string contents;
-    std::fseek(fp, 0, SEEK_END);
-    contents.resize(std::ftell(fp));
-    std::rewind(fp);
-    std::fread(&contents[0], 1, contents.size(), fp);
-    std::fclose(fp);
-    return(contents);
+    return contents->take();
+}
+
+// lets tinygltf read .gltf files and the buffers and images they reference through ResourceFS
+inline tinygltf::FsCallbacks resourceFsCallbacks() {
+    tinygltf::FsCallbacks callbacks{};
+    callbacks.FileExists = [](const std::string& path, void*) { return ResourceFS::exists(path); };
+    callbacks.ExpandFilePath = [](const std::string& path, void*) { return path; };
+    callbacks.ReadWholeFile = [](std::vector<unsigned char>* out, std::string* err, const std::string& path, void*) {
+        std::optional<ResourceData> contents = ResourceFS::read(path);
+        if (!contents.has_value()) {
+            if (err) {
+                *err += "File open error: " + path + "\n";
+            }
+            return false;
+        }
+        std::span<const char> bytes = contents->bytes();
+        out->assign(bytes.begin(), bytes.end());
+        return true;
+    };
+    callbacks.WriteWholeFile = &tinygltf::WriteWholeFile;
+    callbacks.GetFileSizeInBytes = [](size_t* size, std::string* err, const std::string& path, void*) {
+        std::optional<size_t> file_size = ResourceFS::file_size(path);
+        if (!file_size.has_value()) {
+            if (err) {
+                *err += "File open error: " + path + "\n";
+            }
+            return false;
+        }
+        *size = *file_size;
+        return true;
+    };
+    return callbacks;
 }
 
 struct Uniforms {
@@ -133,6 +167,10 @@ struct RenderConfig {
 	glm::ivec2 size = { 640, 360 };
 	glm::u8vec3 clear_color = { 255, 255, 255 };
 	float zoom = 1.f;
+	// instances whose bounding sphere covers less than this many pixels of radius are not drawn
+	float cull_min_pixels = 0.f;
+	// record each model's draws into a render bundle and replay it while they do not change
+	bool render_bundles = true;
 
 	RenderConfig();
 };
@@ -797,15 +835,54 @@ struct Transform {
     Transform(glm::vec3 translation, glm::vec3 rotation, glm::vec3 scale) : translation(translation), rotation(rotation), scale(scale) {}
 };
 
+// model space bounds of a mesh, with the glTF node transform already applied
+struct Bounds {
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+
+    void add(glm::vec3 point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    // nothing was added; center() and radius() are not finite then
+    bool empty() const {
+        return min.x > max.x;
+    }
+
+    Bounds transformed(const glm::mat4x4& matrix) const {
+        Bounds result;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 point((corner & 1) ? max.x : min.x, (corner & 2) ? max.y : min.y, (corner & 4) ? max.z : min.z);
+            result.add(glm::vec3(matrix * glm::vec4(point, 1.f)));
+        }
+        return result;
+    }
+
+    glm::vec3 center() const {
+        return (min + max) * .5f;
+    }
+
+    float radius() const {
+        return glm::length(max - min) * .5f;
+    }
+};
+
+// Generational slot map. Items are packed densely so iteration only touches live ones; an Index goes through its slot to
+// the item's position, and removal moves the last item into the hole. Free slots form a list threaded through position.
 template<typename T>
 class Table {
-    struct Item {
-        T data;
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+    struct Slot {
+        size_t position;
         size_t generation;
     };
 
-    std::vector<Item> items;
-    std::unordered_set<size_t> free;
+    std::vector<Slot> slots;
+    std::vector<T> items;
+    std::vector<size_t> owners;
+    size_t free_head = npos;
 
 public:
     class Index {
@@ -828,54 +905,86 @@ public:
 
     Index add(T data) {
         size_t index;
-        if (free.empty()) {
-            index = items.size();
-            items.push_back({std::move(data), 0});
+        if (free_head == npos) {
+            index = slots.size();
+            slots.push_back({items.size(), 0});
         } else {
-            auto it = free.begin();
-            index = *it;
-            free.erase(it);
-            items[index] = {std::move(data), items[index].generation + 1};
+            index = free_head;
+            free_head = slots[index].position;
+            slots[index].position = items.size();
         }
-        return Index(index, items[index].generation);
+        items.push_back(std::move(data));
+        owners.push_back(index);
+        return Index(index, slots[index].generation);
     }
 
-    void remove(Index index) {
-        if (index.generation != items[index.index].generation) {
-            return;
+    // Returns the position the item occupied, which now holds the item that was last (unless it was the last itself,
+    // then it is == size()). Removing a stale index does nothing and returns npos.
+    size_t remove(Index index) {
+        if (!contains(index)) {
+            return npos;
+        }
+        Slot& slot = slots[index.index];
+        size_t position = slot.position;
+        size_t last = items.size() - 1;
+        if (position != last) {
+            items[position] = std::move(items[last]);
+            owners[position] = owners[last];
+            slots[owners[position]].position = position;
         }
-        free.insert(index.index);
-        items[index.index].generation++;
+        items.pop_back();
+        owners.pop_back();
+        slot.generation++;
+        slot.position = free_head;
+        free_head = index.index;
+        return position;
     }
 
-    T& operator[](Index index) {
-        if (index.generation != items[index.index].generation) {
+    bool contains(Index index) const {
+        return index.index < slots.size() && index.generation == slots[index.index].generation;
+    }
+
+    size_t position(Index index) const {
+        if (!contains(index)) {
             throw std::runtime_error("Invalid index");
         }
-        return items[index.index].data;
+        return slots[index.index].position;
+    }
+
+    T& operator[](Index index) {
+        return items[position(index)];
     }
 
     const T& operator[](Index index) const {
-        if (index.generation != items[index.index].generation) {
-            throw std::runtime_error("Invalid index");
-        }
-        return items[index.index].data;
+        return items[position(index)];
+    }
+
+    T& at(size_t position) {
+        return items[position];
+    }
+
+    const T& at(size_t position) const {
+        return items[position];
+    }
+
+    typename std::vector<T>::iterator begin() {
+        return items.begin();
     }
 
-    bool valid(size_t index) const {
-        return index < items.size() && free.find(index) == free.end();
+    typename std::vector<T>::iterator end() {
+        return items.end();
     }
 
-    T& rawget(size_t index) {
-        return items[index].data;
+    typename std::vector<T>::const_iterator begin() const {
+        return items.begin();
     }
 
-    const T& rawget(size_t index) const {
-        return items[index].data;
+    typename std::vector<T>::const_iterator end() const {
+        return items.end();
     }
 
     size_t size() const {
-        return items.size() - free.size();
+        return items.size();
     }
 
     size_t capacity() const {
@@ -884,108 +993,689 @@ public:
 };
 
 constexpr size_t UNCHANGED = std::numeric_limits<size_t>::max();
-struct DynamicTransformBuffer {
+// One GPU buffer holds the instance matrices of every model type. Each DynamicTransformBuffer owns a region of it and
+// draws with firstInstance at the region's offset. Writes go to a CPU mirror and are uploaded once per frame as a few
+// coalesced ranges. A region that outgrows its capacity moves to the end, and the arena is repacked (shrinking regions
+// to fit) once that would halve its size.
+class InstanceArena {
+    // clean matrices between two dirty ranges are re-uploaded rather than splitting the write, up to this many
+    static constexpr size_t merge_gap = 4;
+    static constexpr size_t min_region = 16;
+
+    struct Region {
+        size_t offset;
+        size_t capacity;
+        size_t count;
+    };
+
     WGPUDevice device;
     WGPUQueue queue;
-    WGPUBufferDescriptor descriptor;
     WGPUBufferHolder buffer = WGPUBufferHolder(nullptr, voidDeleter);
-    Table<Transform> data;
-    bool changed = false;
+    size_t buffer_capacity = 0;
+    size_t buffer_generation = 0;
+    std::vector<glm::mat4x4> mirror;
+    std::vector<Region> regions;
+    size_t end = 0;
+    // [first, end) instance ranges written since the last upload
+    std::vector<std::pair<size_t, size_t>> dirty;
+    bool all_dirty = false;
+
+    size_t place(size_t capacity) {
+        size_t offset = end;
+        end += capacity;
+        mirror.resize(end);
+        return offset;
+    }
+
+public:
+    using RegionId = size_t;
+
+    InstanceArena(WGPUDevice device, WGPUQueue queue) : device(device), queue(queue) {}
+
+    RegionId allocate() {
+        regions.push_back({ place(min_region), min_region, 0 });
+        return regions.size() - 1;
+    }
+
+    // the region will hold count instances; moves it (and what it holds) to the end if it is too small
+    void reserve(RegionId id, size_t count) {
+        Region& region = regions[id];
+        if (count > region.capacity) {
+            size_t capacity = std::max(count, region.capacity * 2);
+            size_t offset = place(capacity);
+            std::copy_n(mirror.begin() + region.offset, region.count, mirror.begin() + offset);
+            dirty.push_back({ offset, offset + region.count });
+            region.offset = offset;
+            region.capacity = capacity;
+        }
+        region.count = count;
+    }
+
+    void write(RegionId id, size_t first, const glm::mat4x4* data, size_t count) {
+        if (count == 0) {
+            return;
+        }
+        size_t offset = regions[id].offset + first;
+        std::copy_n(data, count, mirror.begin() + offset);
+        dirty.push_back({ offset, offset + count });
+    }
+
+    size_t offset(RegionId id) const {
+        return regions[id].offset;
+    }
+
+    static size_t packed_capacity(size_t count) {
+        return std::max(min_region, count + count / 2);
+    }
+
+    // repacks the regions in order, each with a little room to grow, once that would halve the arena; call before any
+    // region is written this frame
+    void compact() {
+        size_t packed_size = 0;
+        for (const Region& region : regions) {
+            packed_size += packed_capacity(region.count);
+        }
+        if (packed_size * 2 > end || end < 1024) {
+            return;
+        }
+        std::vector<glm::mat4x4> packed;
+        packed.reserve(packed_size);
+        for (Region& region : regions) {
+            size_t offset = packed.size();
+            packed.insert(packed.end(), mirror.begin() + region.offset, mirror.begin() + region.offset + region.count);
+            region.offset = offset;
+            region.capacity = packed_capacity(region.count);
+            packed.resize(offset + region.capacity);
+        }
+        std::cout << "Compacted instance arena from " << end << " to " << packed.size() << " instances" << std::endl;
+        mirror = std::move(packed);
+        end = mirror.size();
+        all_dirty = true;
+    }
+
+    WGPUBuffer upload() {
+        if (buffer_capacity < end) {
+            buffer_capacity = std::max(end, buffer_capacity * 2);
+            WGPUBufferDescriptor descriptor = {
+                .nextInChain = nullptr,
+                .label = "Instance transform arena",
+                .usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex,
+                .size = buffer_capacity * sizeof(glm::mat4x4),
+                .mappedAtCreation = false,
+            };
+            std::cout << "Resizing instance arena to " << descriptor.size << " bytes" << std::endl;
+            buffer = createBuffer(device, descriptor);
+            buffer_generation++;
+            all_dirty = true;
+        }
+        if (all_dirty) {
+            dirty.assign(1, { 0, end });
+            all_dirty = false;
+        }
+        std::sort(dirty.begin(), dirty.end());
+        size_t range_first = 0;
+        size_t range_end = 0;
+        for (auto [first, last] : dirty) {
+            if (range_end != range_first && first > range_end + merge_gap) {
+                wgpuQueueWriteBuffer(queue, buffer.get(), range_first * sizeof(glm::mat4x4), mirror.data() + range_first, (range_end - range_first) * sizeof(glm::mat4x4));
+                range_first = first;
+            } else if (range_end == range_first) {
+                range_first = first;
+            }
+            range_end = std::max(range_end, last);
+        }
+        if (range_end != range_first) {
+            wgpuQueueWriteBuffer(queue, buffer.get(), range_first * sizeof(glm::mat4x4), mirror.data() + range_first, (range_end - range_first) * sizeof(glm::mat4x4));
+        }
+        dirty.clear();
+        return buffer.get();
+    }
+
+    // the GPU buffer's size, which only changes when it is replaced
+    size_t bufferSize() const {
+        return buffer_capacity * sizeof(glm::mat4x4);
+    }
+
+    // bumped whenever upload replaces the GPU buffer
+    size_t generation() const {
+        return buffer_generation;
+    }
+};
+
+// First fit allocator of [offset, offset + count) ranges; freed ranges merge with their neighbours
+class RangeAllocator {
+    // offset -> count of every free range below end
+    std::map<size_t, size_t> free_ranges;
+    size_t end = 0;
+
+public:
+    size_t allocate(size_t count) {
+        for (auto it = free_ranges.begin(); it != free_ranges.end(); it++) {
+            if (it->second >= count) {
+                auto [offset, free_count] = *it;
+                free_ranges.erase(it);
+                if (free_count > count) {
+                    free_ranges[offset + count] = free_count - count;
+                }
+                return offset;
+            }
+        }
+        size_t offset = end;
+        end += count;
+        return offset;
+    }
+
+    void free(size_t offset, size_t count) {
+        if (count == 0) {
+            return;
+        }
+        auto next = free_ranges.lower_bound(offset);
+        if (next != free_ranges.end() && next->first == offset + count) {
+            count += next->second;
+            next = free_ranges.erase(next);
+        }
+        if (next != free_ranges.begin()) {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset) {
+                offset = previous->first;
+                count += previous->second;
+                free_ranges.erase(previous);
+            }
+        }
+        if (offset + count == end) {
+            end = offset;
+        } else {
+            free_ranges[offset] = count;
+        }
+    }
+
+    // one past the highest allocated offset
+    size_t size() const {
+        return end;
+    }
+};
+
+// draw calls and state changes encoded in the last frame, state changes skipped because nothing changed, and render
+// bundles replayed unchanged or recorded (or drawn without one) because their draws changed
+struct RenderStats {
+    size_t draws = 0;
+    size_t binds = 0;
+    size_t skipped = 0;
+    size_t bundle_hits = 0;
+    size_t bundle_misses = 0;
+};
+
+// the commands EncoderState uses, for both encoder types
+inline void encodeSetPipeline(WGPURenderPassEncoder encoder, WGPURenderPipeline pipeline) { wgpuRenderPassEncoderSetPipeline(encoder, pipeline); }
+inline void encodeSetPipeline(WGPURenderBundleEncoder encoder, WGPURenderPipeline pipeline) { wgpuRenderBundleEncoderSetPipeline(encoder, pipeline); }
+inline void encodeSetBindGroup(WGPURenderPassEncoder encoder, uint32_t index, WGPUBindGroup group) { wgpuRenderPassEncoderSetBindGroup(encoder, index, group, 0, nullptr); }
+inline void encodeSetBindGroup(WGPURenderBundleEncoder encoder, uint32_t index, WGPUBindGroup group) { wgpuRenderBundleEncoderSetBindGroup(encoder, index, group, 0, nullptr); }
+inline void encodeSetVertexBuffer(WGPURenderPassEncoder encoder, uint32_t slot, WGPUBuffer buffer, uint64_t size) { wgpuRenderPassEncoderSetVertexBuffer(encoder, slot, buffer, 0, size); }
+inline void encodeSetVertexBuffer(WGPURenderBundleEncoder encoder, uint32_t slot, WGPUBuffer buffer, uint64_t size) { wgpuRenderBundleEncoderSetVertexBuffer(encoder, slot, buffer, 0, size); }
+inline void encodeSetIndexBuffer(WGPURenderPassEncoder encoder, WGPUBuffer buffer, uint64_t size) { wgpuRenderPassEncoderSetIndexBuffer(encoder, buffer, WGPUIndexFormat_Uint16, 0, size); }
+inline void encodeSetIndexBuffer(WGPURenderBundleEncoder encoder, WGPUBuffer buffer, uint64_t size) { wgpuRenderBundleEncoderSetIndexBuffer(encoder, buffer, WGPUIndexFormat_Uint16, 0, size); }
+inline void encodeDrawIndexed(WGPURenderPassEncoder encoder, uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t base_vertex, uint32_t first_instance) {
+    wgpuRenderPassEncoderDrawIndexed(encoder, index_count, instance_count, first_index, base_vertex, first_instance);
+}
+inline void encodeDrawIndexed(WGPURenderBundleEncoder encoder, uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t base_vertex, uint32_t first_instance) {
+    wgpuRenderBundleEncoderDrawIndexed(encoder, index_count, instance_count, first_index, base_vertex, first_instance);
+}
+
+// Forwards state changes to a render pass or bundle encoder, dropping those that rebind what is already bound
+template<typename Encoder>
+class EncoderState {
+    static constexpr size_t bind_group_count = 3;
+    static constexpr size_t vertex_buffer_count = 4;
+
+    Encoder encoder;
+    RenderStats& stats;
+    WGPURenderPipeline pipeline = nullptr;
+    std::array<WGPUBindGroup, bind_group_count> bind_groups = {};
+    std::array<std::pair<WGPUBuffer, uint64_t>, vertex_buffer_count> vertex_buffers = {};
+    std::pair<WGPUBuffer, uint64_t> index_buffer = {};
+
+    bool changed(bool different) {
+        (different ? stats.binds : stats.skipped)++;
+        return different;
+    }
+
+public:
+    EncoderState(Encoder encoder, RenderStats& stats) : encoder(encoder), stats(stats) {}
+
+    void setPipeline(WGPURenderPipeline new_pipeline) {
+        if (changed(pipeline != new_pipeline)) {
+            pipeline = new_pipeline;
+            encodeSetPipeline(encoder, pipeline);
+        }
+    }
+
+    void setBindGroup(uint32_t index, WGPUBindGroup group) {
+        if (changed(bind_groups[index] != group)) {
+            bind_groups[index] = group;
+            encodeSetBindGroup(encoder, index, group);
+        }
+    }
+
+    void setVertexBuffer(uint32_t slot, WGPUBuffer buffer, uint64_t size) {
+        if (changed(vertex_buffers[slot] != std::make_pair(buffer, size))) {
+            vertex_buffers[slot] = { buffer, size };
+            encodeSetVertexBuffer(encoder, slot, buffer, size);
+        }
+    }
+
+    void setIndexBuffer(WGPUBuffer buffer, uint64_t size) {
+        if (changed(index_buffer != std::make_pair(buffer, size))) {
+            index_buffer = { buffer, size };
+            encodeSetIndexBuffer(encoder, buffer, size);
+        }
+    }
+
+    void drawIndexed(uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t base_vertex, uint32_t first_instance) {
+        stats.draws++;
+        encodeDrawIndexed(encoder, index_count, instance_count, first_index, base_vertex, first_instance);
+    }
+};
+using RenderPassState = EncoderState<WGPURenderPassEncoder>;
+using RenderBundleState = EncoderState<WGPURenderBundleEncoder>;
+
+// A GPU buffer that doubles when written past its end, copying what it held on the GPU
+class GrowableBuffer {
+    WGPUDevice device;
+    WGPUQueue queue;
+    const char* label;
+    WGPUBufferUsageFlags usage;
+    WGPUBufferHolder buffer = WGPUBufferHolder(nullptr, voidDeleter);
+    size_t capacity = 0;
+    size_t buffer_generation = 0;
+
+public:
+    GrowableBuffer(WGPUDevice device, WGPUQueue queue, const char* label, WGPUBufferUsageFlags usage)
+        : device(device), queue(queue), label(label), usage(usage | WGPUBufferUsage_CopyDst | WGPUBufferUsage_CopySrc) {}
+
+    void write(size_t offset, const void* data, size_t size) {
+        if (offset + size > capacity) {
+            grow(offset + size);
+        }
+        wgpuQueueWriteBuffer(queue, buffer.get(), offset, data, size);
+    }
+
+    void grow(size_t size) {
+        size_t new_capacity = std::max<size_t>(std::max(size, capacity * 2), 1 << 16);
+        WGPUBufferDescriptor descriptor = {
+            .nextInChain = nullptr,
+            .label = label,
+            .usage = usage,
+            .size = new_capacity,
+            .mappedAtCreation = false,
+        };
+        std::cout << "Resizing " << label << " to " << new_capacity << " bytes" << std::endl;
+        WGPUBufferHolder new_buffer = createBuffer(device, descriptor);
+        if (capacity > 0) {
+            WGPUCommandEncoderDescriptor encoder_desc = {
+                .nextInChain = nullptr,
+                .label = "Geometry copy encoder",
+            };
+            WGPUCommandEncoderHolder encoder(wgpuDeviceCreateCommandEncoder(device, &encoder_desc), wgpuCommandEncoderRelease);
+            wgpuCommandEncoderCopyBufferToBuffer(encoder.get(), buffer.get(), 0, new_buffer.get(), 0, capacity);
+            WGPUCommandBufferDescriptor command_desc = {
+                .nextInChain = nullptr,
+                .label = "Geometry copy",
+            };
+            WGPUCommandBufferHolder command(wgpuCommandEncoderFinish(encoder.get(), &command_desc), wgpuCommandBufferRelease);
+            WGPUCommandBuffer command_ptr = command.get();
+            wgpuQueueSubmit(queue, 1, &command_ptr);
+        }
+        buffer = std::move(new_buffer);
+        capacity = new_capacity;
+        buffer_generation++;
+    }
+
+    WGPUBuffer get() const {
+        return buffer.get();
+    }
+
+    size_t size() const {
+        return capacity;
+    }
+
+    size_t generation() const {
+        return buffer_generation;
+    }
+};
+
+// Vertex attributes and indices of every mesh, packed into one buffer per attribute and one index buffer so they are
+// bound once per frame. A primitive draws with its first_index and base_vertex.
+class GeometryArena {
+    RangeAllocator vertices;
+    RangeAllocator indices;
+    GrowableBuffer positions;
+    GrowableBuffer normals;
+    GrowableBuffer texcoords;
+    GrowableBuffer index_buffer;
+
+public:
+    struct Range {
+        uint32_t base_vertex;
+        uint32_t vertex_count;
+        uint32_t first_index;
+        uint32_t index_count;
+    };
+
+    GeometryArena(WGPUDevice device, WGPUQueue queue)
+        : positions(device, queue, "Position arena", WGPUBufferUsage_Vertex),
+          normals(device, queue, "Normal arena", WGPUBufferUsage_Vertex),
+          texcoords(device, queue, "Texcoord arena", WGPUBufferUsage_Vertex),
+          index_buffer(device, queue, "Index arena", WGPUBufferUsage_Index) {}
+
+    // texcoords may be null; the shader ignores them for untextured primitives
+    Range add(const glm::vec3* position_data, const glm::vec3* normal_data, const glm::vec2* texcoord_data, size_t vertex_count,
+              const uint16_t* index_data, size_t index_count) {
+        // even index counts keep every index range 4 byte aligned (COPY_BUFFER_ALIGNMENT)
+        size_t padded_count = (index_count + 1) & ~size_t(1);
+        Range range = {
+            .base_vertex = static_cast<uint32_t>(vertices.allocate(vertex_count)),
+            .vertex_count = static_cast<uint32_t>(vertex_count),
+            .first_index = static_cast<uint32_t>(indices.allocate(padded_count)),
+            .index_count = static_cast<uint32_t>(index_count),
+        };
+        positions.write(range.base_vertex * sizeof(glm::vec3), position_data, vertex_count * sizeof(glm::vec3));
+        normals.write(range.base_vertex * sizeof(glm::vec3), normal_data, vertex_count * sizeof(glm::vec3));
+        if (texcoord_data != nullptr) {
+            texcoords.write(range.base_vertex * sizeof(glm::vec2), texcoord_data, vertex_count * sizeof(glm::vec2));
+        } else if (vertices.size() * sizeof(glm::vec2) > texcoords.size()) {
+            texcoords.grow(vertices.size() * sizeof(glm::vec2));
+        }
+        std::vector<uint16_t> padded(index_data, index_data + index_count);
+        padded.resize(padded_count);
+        index_buffer.write(range.first_index * sizeof(uint16_t), padded.data(), padded_count * sizeof(uint16_t));
+        return range;
+    }
+
+    void remove(Range range) {
+        vertices.free(range.base_vertex, range.vertex_count);
+        indices.free(range.first_index, (range.index_count + 1) & ~uint32_t(1));
+    }
+
+    template<typename Encoder>
+    void bind(EncoderState<Encoder>& state) const {
+        if (index_buffer.get() == nullptr) {
+            return;
+        }
+        state.setVertexBuffer(0, positions.get(), positions.size());
+        state.setVertexBuffer(1, normals.get(), normals.size());
+        state.setVertexBuffer(2, texcoords.get(), texcoords.size());
+        state.setIndexBuffer(index_buffer.get(), index_buffer.size());
+    }
+
+    // changes whenever one of the buffers bind binds is replaced
+    size_t generation() const {
+        return positions.generation() + normals.generation() + texcoords.generation() + index_buffer.generation();
+    }
+};
+
+// Instances live in a Table, and the matrices of all of them (in the table's dense order) or, when some are culled, of
+// the visible ones go into the buffer's region of the InstanceArena. Writes mark positions dirty; update recomputes only
+// those matrices and writes them to the arena as coalesced ranges.
+struct DynamicTransformBuffer {
+    // clean matrices between two dirty ones are written again rather than splitting the write, up to this many
+    static constexpr size_t merge_gap = 4;
+
+    InstanceArena* arena;
+    InstanceArena::RegionId region;
+    Table<Transform> transforms;
+    std::vector<glm::mat4x4> matrices;
+    std::vector<uint8_t> is_dirty;
+    std::vector<size_t> dirty;
+    // whether the region holds every matrix, in order, rather than just the visible ones
+    bool region_holds_all = true;
+    std::vector<glm::mat4x4> visible_matrices;
+    std::vector<size_t> visible_positions;
+    std::vector<size_t> last_visible_positions;
     size_t current_instance_count = 0;
+    size_t visible_instance_count = 0;
+
+    void markDirty(size_t position) {
+        if (!is_dirty[position]) {
+            is_dirty[position] = 1;
+            dirty.push_back(position);
+        }
+    }
+
+    // gathers the dirty transforms into batches and runs the widest SIMD kernel on them; same result as toMatrix
+    void computeMatrices() {
+        transform_kernel::Streams streams;
+        glm::mat4x4* out[transform_kernel::batch_size];
+        const transform_kernel::Kernel kernel = transform_kernel::best().kernel;
+        for (size_t first = 0; first < dirty.size(); first += transform_kernel::batch_size) {
+            size_t batch = std::min(transform_kernel::batch_size, dirty.size() - first);
+            for (size_t i = 0; i < batch; i++) {
+                size_t position = dirty[first + i];
+                const Transform& transform = transforms.at(position);
+                for (int axis = 0; axis < 3; axis++) {
+                    streams.values[transform_kernel::TranslationX + axis][i] = transform.translation[axis];
+                    streams.values[transform_kernel::RotationX + axis][i] = transform.rotation[axis];
+                    streams.values[transform_kernel::ScaleX + axis][i] = transform.scale[axis];
+                }
+                out[i] = &matrices[position];
+            }
+            kernel(streams, batch, out);
+        }
+    }
+
+    // tests every instance's bounding sphere against the frustum, filling visible_positions
+    void cull(const Bounds& bounds, const transform_kernel::Frustum& frustum) {
+        const size_t count = transforms.size();
+        const glm::vec4 center(bounds.center(), 1.f);
+        const float radius = bounds.radius();
+        const transform_kernel::CullKernel kernel = transform_kernel::best().cull;
+        transform_kernel::Spheres spheres;
+        visible_positions.clear();
+        for (size_t first = 0; first < count; first += transform_kernel::batch_size) {
+            size_t batch = std::min(transform_kernel::batch_size, count - first);
+            for (size_t i = 0; i < batch; i++) {
+                const glm::mat4x4& matrix = matrices[first + i];
+                glm::vec4 world_center = matrix * center;
+                float scale = std::max(glm::dot(matrix[0], matrix[0]), std::max(glm::dot(matrix[1], matrix[1]), glm::dot(matrix[2], matrix[2])));
+                spheres.values[transform_kernel::CenterX][i] = world_center.x;
+                spheres.values[transform_kernel::CenterY][i] = world_center.y;
+                spheres.values[transform_kernel::CenterZ][i] = world_center.z;
+                spheres.values[transform_kernel::Radius][i] = radius * std::sqrt(scale);
+            }
+            uint64_t visible = kernel(spheres, batch, frustum);
+            while (visible != 0) {
+                visible_positions.push_back(first + std::countr_zero(visible));
+                visible &= visible - 1;
+            }
+        }
+    }
 
 public:
     using Index = Table<Transform>::Index;
 
-    DynamicTransformBuffer(WGPUDevice device, WGPUQueue queue, WGPUBufferDescriptor descriptor) : device(device), queue(queue), descriptor(descriptor) {
-        this->descriptor.size = 0;
-    }
+    DynamicTransformBuffer(InstanceArena* arena) : arena(arena), region(arena->allocate()) {}
 
     const Transform& operator[](Index index) const {
-        return data[index];
+        return transforms[index];
     }
 
     Transform& operator[](Index index) {
-        changed = true;
-        return data[index];
+        size_t position = transforms.position(index);
+        markDirty(position);
+        return transforms.at(position);
     }
 
     Index add(const Transform& value) {
-        changed = true;
-        return data.add(value);
+        Index index = transforms.add(value);
+        matrices.emplace_back();
+        is_dirty.push_back(0);
+        markDirty(matrices.size() - 1);
+        return index;
     }
 
     void remove(Index index) {
-        changed = true;
-        data.remove(index);
+        if (!transforms.contains(index)) {
+            return;
+        }
+        size_t position = transforms.remove(index);
+        matrices.pop_back();
+        is_dirty.pop_back();
+        // the last instance moved into position; a stale entry for the old last may stay in dirty, update skips it
+        if (position < transforms.size()) {
+            markDirty(position);
+        }
     }
 
-    WGPUBuffer getBuffer(std::vector<glm::mat4x4>& ancilla) {
-        if (!changed) {
-            return buffer.get();
+    // Recomputes dirty matrices and culls. If nothing was culled the region gets the dirty ranges; otherwise it gets the
+    // visible matrices, but only when one of them or the visible set changed, so instances that never move cost no
+    // upload while the camera is still. Call between InstanceArena::compact and InstanceArena::upload.
+    void update(const Bounds& bounds, const transform_kernel::Frustum& frustum) {
+        const size_t count = transforms.size();
+        std::sort(dirty.begin(), dirty.end());
+        dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+        dirty.erase(std::lower_bound(dirty.begin(), dirty.end(), count), dirty.end());
+        const bool updated = !dirty.empty() || count != current_instance_count;
+        computeMatrices();
+        for (size_t position : dirty) {
+            is_dirty[position] = 0;
         }
-        if (descriptor.size < data.size() * sizeof(glm::mat4x4)) {
-            std::cout << "Resizing buffer \"" << descriptor.label << "\" to " << data.size() * sizeof(glm::mat4x4) << " bytes" << std::endl;
-            descriptor.size = data.capacity() * sizeof(glm::mat4x4);
-            buffer = createBuffer(device, descriptor);
+        current_instance_count = count;
+        cull(bounds, frustum);
+        visible_instance_count = visible_positions.size();
+
+        if (visible_instance_count < count) {
+            if (updated || region_holds_all || visible_positions != last_visible_positions) {
+                std::swap(visible_positions, last_visible_positions);
+                visible_matrices.clear();
+                for (size_t position : last_visible_positions) {
+                    visible_matrices.push_back(matrices[position]);
+                }
+                arena->reserve(region, visible_instance_count);
+                arena->write(region, 0, visible_matrices.data(), visible_instance_count);
+                region_holds_all = false;
+            }
+            dirty.clear();
+            return;
+        }
+        last_visible_positions.clear();
+        arena->reserve(region, count);
+        if (!region_holds_all) {
+            arena->write(region, 0, matrices.data(), count);
+            region_holds_all = true;
+            dirty.clear();
+            return;
         }
-        ancilla.clear();
-        for (size_t i = 0; i <= data.capacity(); i++) {
-            if (data.valid(i)) {
-                ancilla.push_back(data.rawget(i).toMatrix());
+        size_t range_first = 0;
+        size_t range_end = 0;
+        for (size_t position : dirty) {
+            if (range_end != range_first && position > range_end + merge_gap) {
+                arena->write(region, range_first, matrices.data() + range_first, range_end - range_first);
+                range_first = position;
+            } else if (range_end == range_first) {
+                range_first = position;
             }
+            range_end = position + 1;
         }
-        wgpuQueueWriteBuffer(
-            queue,
-            buffer.get(),
-            0,
-            ancilla.data(),
-            ancilla.size() * sizeof(glm::mat4x4));
-        changed = false;
-        current_instance_count = data.size();
-        return buffer.get();
+        arena->write(region, range_first, matrices.data() + range_first, range_end - range_first);
+        dirty.clear();
     }
 
     size_t count() const {
         return current_instance_count;
     }
 
-    size_t size() const {
-        return current_instance_count * sizeof(glm::mat4x4);
+    size_t visibleCount() const {
+        return visible_instance_count;
+    }
+
+    // the firstInstance to draw with
+    uint32_t firstInstance() const {
+        return static_cast<uint32_t>(arena->offset(region));
     }
 };
 
+// instances drawn and skipped by culling in the last frame
+struct CullStats {
+    size_t visible = 0;
+    size_t culled = 0;
+};
+
 struct GameConfig;
 
 const char* get_window_title(GameConfig* config);
 
 class Renderer {
     struct ModelPrimitive {
-        WGPUBufferHolder position_buffer;
-        WGPUBufferHolder normal_buffer;
-        WGPUBufferHolder index_buffer;
-        WGPUBufferHolder texcoord_buffer;
+        GeometryArena::Range geometry;
 
         WGPUBufferHolder uniform_buffer;
         WGPUTextureHolder texture;
         WGPUTextureViewHolder texture_view;
         WGPUSamplerHolder sampler;
         WGPUBindGroupHolder bind_group;
+        uint32_t material_key;
+    };
+
+    // what a transform buffer's draws depend on besides the model's (immutable) bind groups and primitives
+    struct BundleSignature {
+        size_t instance_generation = 0;
+        size_t geometry_generation = 0;
+        size_t visible = 0;
+        uint32_t first_instance = 0;
+
+        bool operator==(const BundleSignature&) const = default;
+    };
+    struct RenderBundleCache {
+        WGPURenderBundleHolder bundle = {nullptr, voidDeleter};
+        BundleSignature signature;
     };
 
     struct ModelType {
         std::vector<ModelPrimitive> primitives;
         DynamicTransformBuffer transforms;
+        // instances that are not expected to move, kept apart so moving ones never cause their matrices to be uploaded
+        DynamicTransformBuffer static_transforms;
         WGPUBufferHolder model_uniform_buffer;
         WGPUBindGroupHolder model_bind_group;
+        uint32_t model_key;
+        Bounds bounds;
+        RenderBundleCache bundle;
+        RenderBundleCache static_bundle;
+    };
+    // one draw of a primitive's visible instances in a transform buffer
+    struct Draw {
+        uint64_t key;
+        const ModelPrimitive* primitive;
+        const DynamicTransformBuffer* transforms;
+        WGPUBindGroup model_bind_group;
+        RenderBundleCache* bundle;
     };
-    std::vector<glm::mat4x4> transform_matrix_buffer;
+    // models parsed off the main thread by prefetchModel, waiting for loadModel to upload them
+    struct DecodedModels {
+        std::mutex mutex;
+        std::condition_variable done;
+        std::unordered_set<std::string> requested;
+        std::unordered_set<std::string> in_progress;
+        std::unordered_map<std::string, tinygltf::Model> ready;
+    };
+
     std::unordered_map<std::string, ModelHandle> model_types;
     std::vector<ModelType> models;
+    std::unique_ptr<InstanceArena> instance_arena;
+    std::unique_ptr<GeometryArena> geometry_arena;
+    std::unique_ptr<DecodedModels> decoded_models = std::make_unique<DecodedModels>();
 
     std::shared_ptr<GameConfig> game_config;
     RenderConfig render_config;
 
     Transform camera_transform;
+    glm::mat4x4 camera_projection = glm::mat4x4(1.f);
+    CullStats cull_stats;
+    RenderStats render_stats;
+    std::vector<Draw> draw_list;
+    std::vector<Draw> direct_draws;
+    std::vector<WGPURenderBundle> frame_bundles;
+    // sort key part of each bind group, in order of first use
+    std::unordered_map<WGPUBindGroup, uint32_t> bind_group_keys;
     WGPUBufferHolder uniform_buffer = {nullptr, voidDeleter};
     WGPUBindGroupHolder bind_group = {nullptr, voidDeleter};
 
@@ -1010,6 +1700,7 @@ class Renderer {
     WGPUBufferHolder default_model_uniform_buffer = {nullptr, voidDeleter};
     WGPUBindGroupHolder default_model_bind_group = {nullptr, voidDeleter};
     WGPUBufferHolder default_primitive_uniform_buffer = {nullptr, voidDeleter};
+    WGPUBindGroupHolder default_primitive_bind_group = {nullptr, voidDeleter};
     WGPUBindGroupLayoutHolder model_bind_group_layout = {nullptr, voidDeleter};
     WGPUBindGroupLayoutHolder primitive_bind_group_layout = {nullptr, voidDeleter};
     WGPUTextureHolder default_texture = {nullptr, voidDeleter};
@@ -1052,6 +1743,7 @@ class Renderer {
     void renderFrame(WGPUTextureView current_texture) {
         glm::mat4x4 camera_transform_matrix = glm::inverse(camera_transform.toMatrix());
         wgpuQueueWriteBuffer(queue.get(), uniform_buffer.get(), offsetof(Uniforms, view), &camera_transform_matrix, TRANSFORM_SIZE);
+        WGPUBuffer instance_buffer = updateInstances(makeFrustum(camera_projection * camera_transform_matrix));
 
         WGPUCommandEncoderDescriptor encoderDesc = {
             .nextInChain = nullptr,
@@ -1106,11 +1798,10 @@ class Renderer {
             .timestampWrites = nullptr,
         };
 
+        buildDrawList();
+        render_stats = {};
         WGPURenderPassEncoderHolder render_pass(wgpuCommandEncoderBeginRenderPass(encoder.get(), &renderPassDesc), wgpuRenderPassEncoderRelease);
-        wgpuRenderPassEncoderSetPipeline(render_pass.get(), pipeline.get());
-        for (auto& model_data : models) {
-            renderModelType(render_pass.get(), model_data);
-        }
+        renderDrawList(render_pass.get(), instance_buffer);
         wgpuRenderPassEncoderEnd(render_pass.get());
 
         WGPUCommandBufferDescriptor cmdBufferDescriptor = {};
@@ -1122,21 +1813,158 @@ class Renderer {
         wgpuQueueSubmit(queue.get(), 1, &commandPtr);
     }
 
-    void renderModelType(WGPURenderPassEncoder render_pass, ModelType& model_data) {
-        WGPUBuffer transform_buffer = model_data.transforms.getBuffer(transform_matrix_buffer);
-        if (model_data.transforms.count() == 0) {
+    // Gribb-Hartmann plane extraction; clip space depth is 0..1 (GLM_FORCE_DEPTH_ZERO_TO_ONE), so near is row 2 alone
+    transform_kernel::Frustum makeFrustum(const glm::mat4x4& view_projection) const {
+        const glm::mat4x4 rows = glm::transpose(view_projection);
+        transform_kernel::Frustum frustum;
+        frustum.planes[0] = rows[3] + rows[0];
+        frustum.planes[1] = rows[3] - rows[0];
+        frustum.planes[2] = rows[3] + rows[1];
+        frustum.planes[3] = rows[3] - rows[1];
+        frustum.planes[4] = rows[2];
+        frustum.planes[5] = rows[3] - rows[2];
+        for (glm::vec4& plane : frustum.planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        frustum.depth = rows[3];
+        // a radius r at depth w covers r * projection[1][1] / w of the half height in clip space
+        frustum.pixel_scale = camera_projection[1][1] * static_cast<float>(screen_size.height) * .5f;
+        frustum.min_pixels = render_config.cull_min_pixels;
+        return frustum;
+    }
+
+    // culls every model type's instances and writes them to the instance arena, then uploads it
+    WGPUBuffer updateInstances(const transform_kernel::Frustum& frustum) {
+        cull_stats = {};
+        instance_arena->compact();
+        for (auto& model_data : models) {
+            for (DynamicTransformBuffer* transforms : { &model_data.static_transforms, &model_data.transforms }) {
+                transforms->update(model_data.bounds, frustum);
+                cull_stats.visible += transforms->visibleCount();
+                cull_stats.culled += transforms->count() - transforms->visibleCount();
+            }
+        }
+        return instance_arena->upload();
+    }
+
+    uint32_t bindGroupKey(WGPUBindGroup group) {
+        return bind_group_keys.try_emplace(group, static_cast<uint32_t>(bind_group_keys.size())).first->second;
+    }
+
+    // Draws sort by model bind group, then transform buffer (so each buffer's draws, which share a render bundle, are
+    // contiguous), then material bind group. There is one pipeline and every primitive uses the geometry arena's vertex
+    // buffers, so neither needs bits in the key.
+    void buildDrawList() {
+        draw_list.clear();
+        for (size_t model_index = 0; model_index < models.size(); model_index++) {
+            ModelType& model_data = models[model_index];
+            for (bool is_static : { true, false }) {
+                const DynamicTransformBuffer& transforms = is_static ? model_data.static_transforms : model_data.transforms;
+                if (transforms.visibleCount() == 0) {
+                    continue;
+                }
+                uint64_t group = model_index * 2 + (is_static ? 0 : 1);
+                for (const auto& primitive : model_data.primitives) {
+                    uint64_t key = static_cast<uint64_t>(model_data.model_key) << 40 | group << 20 | primitive.material_key;
+                    draw_list.push_back({ key, &primitive, &transforms, model_data.model_bind_group.get(), is_static ? &model_data.static_bundle : &model_data.bundle });
+                }
+            }
+        }
+        std::sort(draw_list.begin(), draw_list.end(), [](const Draw& a, const Draw& b) { return a.key < b.key; });
+    }
+
+    template<typename Encoder>
+    void bindFrameState(EncoderState<Encoder>& state, WGPUBuffer instance_buffer) {
+        state.setPipeline(pipeline.get());
+        state.setBindGroup(0, bind_group.get());
+        geometry_arena->bind(state);
+        if (instance_buffer != nullptr) {
+            state.setVertexBuffer(3, instance_buffer, instance_arena->bufferSize());
+        }
+    }
+
+    template<typename Encoder>
+    void encodeDraws(EncoderState<Encoder>& state, const Draw* draws, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            const Draw& draw = draws[i];
+            const GeometryArena::Range& geometry = draw.primitive->geometry;
+            state.setBindGroup(1, draw.model_bind_group);
+            state.setBindGroup(2, draw.primitive->bind_group.get());
+            state.drawIndexed(geometry.index_count, static_cast<uint32_t>(draw.transforms->visibleCount()), geometry.first_index, static_cast<int32_t>(geometry.base_vertex), draw.transforms->firstInstance());
+        }
+    }
+
+    // Returns a bundle of a transform buffer's draws: the cached one if nothing they depend on changed, or a newly
+    // recorded one if nothing changed since last frame. Draws that changed since last frame are likely to change again,
+    // so they get no bundle (nullptr) and are encoded directly until they settle.
+    WGPURenderBundle getBundle(const Draw* draws, size_t count, WGPUBuffer instance_buffer) {
+        RenderBundleCache& cache = *draws->bundle;
+        BundleSignature signature = {
+            .instance_generation = instance_arena->generation(),
+            .geometry_generation = geometry_arena->generation(),
+            .visible = draws->transforms->visibleCount(),
+            .first_instance = draws->transforms->firstInstance(),
+        };
+        if (cache.bundle != nullptr && cache.signature == signature) {
+            render_stats.bundle_hits++;
+            return cache.bundle.get();
+        }
+        render_stats.bundle_misses++;
+        if (cache.signature != signature) {
+            cache.signature = signature;
+            cache.bundle.reset();
+            return nullptr;
+        }
+        WGPURenderBundleEncoderDescriptor encoder_desc = {
+            .nextInChain = nullptr,
+            .label = "Model bundle encoder",
+            .colorFormatCount = 1,
+            .colorFormats = &surface_preferred_format,
+            .depthStencilFormat = DEPTH_TEXTURE_FORMAT,
+            .sampleCount = 1,
+            .depthReadOnly = false,
+            .stencilReadOnly = true,
+        };
+        WGPURenderBundleEncoderHolder bundle_encoder(wgpuDeviceCreateRenderBundleEncoder(device.get(), &encoder_desc), wgpuRenderBundleEncoderRelease);
+        RenderBundleState state(bundle_encoder.get(), render_stats);
+        bindFrameState(state, instance_buffer);
+        encodeDraws(state, draws, count);
+        WGPURenderBundleDescriptor bundle_desc = {
+            .nextInChain = nullptr,
+            .label = "Model bundle",
+        };
+        cache.bundle = WGPURenderBundleHolder(wgpuRenderBundleEncoderFinish(bundle_encoder.get(), &bundle_desc), wgpuRenderBundleRelease);
+        return cache.bundle.get();
+    }
+
+    void renderDrawList(WGPURenderPassEncoder render_pass, WGPUBuffer instance_buffer) {
+        RenderPassState state(render_pass, render_stats);
+        if (!render_config.render_bundles) {
+            bindFrameState(state, instance_buffer);
+            encodeDraws(state, draw_list.data(), draw_list.size());
             return;
         }
-        wgpuRenderPassEncoderSetVertexBuffer(render_pass, 3, transform_buffer, 0, model_data.transforms.size());
-        wgpuRenderPassEncoderSetBindGroup(render_pass, 0, bind_group.get(), 0, 0);
-        wgpuRenderPassEncoderSetBindGroup(render_pass, 1, model_data.model_bind_group.get(), 0, 0);
-        for (auto& primitive : model_data.primitives) {
-            wgpuRenderPassEncoderSetVertexBuffer(render_pass, 0, primitive.position_buffer.get(), 0, wgpuBufferGetSize(primitive.position_buffer.get()));
-            wgpuRenderPassEncoderSetVertexBuffer(render_pass, 1, primitive.normal_buffer.get(), 0, wgpuBufferGetSize(primitive.normal_buffer.get()));
-            wgpuRenderPassEncoderSetVertexBuffer(render_pass, 2, primitive.texcoord_buffer.get(), 0, wgpuBufferGetSize(primitive.texcoord_buffer.get()));
-            wgpuRenderPassEncoderSetIndexBuffer(render_pass, primitive.index_buffer.get(), WGPUIndexFormat_Uint16, 0, wgpuBufferGetSize(primitive.index_buffer.get()));
-            wgpuRenderPassEncoderSetBindGroup(render_pass, 2, primitive.bind_group.get(), 0, 0);
-            wgpuRenderPassEncoderDrawIndexed(render_pass, static_cast<uint32_t>(wgpuBufferGetSize(primitive.index_buffer.get()) / sizeof(uint16_t)), static_cast<uint32_t>(model_data.transforms.count()), 0, 0, 0);
+        frame_bundles.clear();
+        direct_draws.clear();
+        for (size_t first = 0; first < draw_list.size();) {
+            size_t last = first + 1;
+            while (last < draw_list.size() && draw_list[last].bundle == draw_list[first].bundle) {
+                last++;
+            }
+            if (WGPURenderBundle bundle = getBundle(&draw_list[first], last - first, instance_buffer)) {
+                frame_bundles.push_back(bundle);
+            } else {
+                direct_draws.insert(direct_draws.end(), draw_list.begin() + first, draw_list.begin() + last);
+            }
+            first = last;
+        }
+        // executing bundles clears the pass's state, so they go before anything is bound
+        if (!frame_bundles.empty()) {
+            wgpuRenderPassEncoderExecuteBundles(render_pass, frame_bundles.size(), frame_bundles.data());
+        }
+        if (!direct_draws.empty()) {
+            bindFrameState(state, instance_buffer);
+            encodeDraws(state, direct_draws.data(), direct_draws.size());
         }
     }
 
@@ -1337,13 +2165,14 @@ public:
     class InstanceHandle {
         ModelHandle model;
         DynamicTransformBuffer::Index transform_index;
+        bool is_static;
 
         friend class Renderer;
-        InstanceHandle(ModelHandle model, DynamicTransformBuffer::Index transform_index) : model(model), transform_index(transform_index) {}
+        InstanceHandle(ModelHandle model, DynamicTransformBuffer::Index transform_index, bool is_static) : model(model), transform_index(transform_index), is_static(is_static) {}
 
     public:
         bool operator==(const InstanceHandle& other) const {
-            return model == other.model && transform_index == other.transform_index;
+            return model == other.model && transform_index == other.transform_index && is_static == other.is_static;
         }
     };
 
@@ -1368,12 +2197,15 @@ public:
         #endif
         adapter_limits = supported_limits.limits;
         device = getDevice(adapter.get(), adapter_limits);
+        std::cout << "Transform kernel: " << transform_kernel::best().name << std::endl;
 
         surface_preferred_format = wgpuSurfaceGetPreferredFormat(surface.get(), adapter.get());
 
         wgpuDeviceGetLimits(device.get(), &supported_limits);
         device_limits = supported_limits.limits;
         queue = getQueue(device.get());
+        instance_arena = std::make_unique<InstanceArena>(device.get(), queue.get());
+        geometry_arena = std::make_unique<GeometryArena>(device.get(), queue.get());
         #if defined(__EMSCRIPTEN__)
         swap_chain = getSwapChain(surface.get(), device.get(), surface_preferred_format, screen_size);
         #else
@@ -1401,6 +2233,7 @@ public:
         depth_texture_view = createDepthTextureView(depth_texture.get());
 
         Uniforms uniforms = make_uniforms();
+        camera_projection = uniforms.projection;
         WGPUBufferDescriptor uniform_buffer_desc = {
             .nextInChain = nullptr,
             .label = "Uniform buffer",
@@ -1434,6 +2267,7 @@ public:
         default_texture = makeTexture("Default image", {16, 16, 1}, default_image.data());
         default_texture_view = makeTextureView(default_texture.get());
         default_sampler = makeSampler("Default sampler");
+        default_primitive_bind_group = createPrimitiveBindGroup("Default primitive bind group", default_primitive_uniform_buffer.get(), default_texture_view.get(), default_sampler.get());
         std::cout << "Renderer initialized" << std::endl;
     }
 
@@ -1462,8 +2296,8 @@ public:
         #endif
         depth_texture = createDepthTexture();
         depth_texture_view = createDepthTextureView(depth_texture.get());
-        glm::mat4x4 projection_matrix = make_uniforms().projection;
-        wgpuQueueWriteBuffer(queue.get(), uniform_buffer.get(), offsetof(Uniforms, projection), &projection_matrix, TRANSFORM_SIZE);
+        camera_projection = make_uniforms().projection;
+        wgpuQueueWriteBuffer(queue.get(), uniform_buffer.get(), offsetof(Uniforms, projection), &camera_projection, TRANSFORM_SIZE);
     }
 
     Transform& getCameraTransform() {
@@ -1474,24 +2308,126 @@ public:
         return camera_transform;
     }
 
-    ModelHandle loadModel(std::string filename) {
-        if (model_types.find(filename) != model_types.end()) {
-            return model_types[filename];
-        }
+    const CullStats& getCullStats() const {
+        return cull_stats;
+    }
+
+    const RenderStats& getRenderStats() const {
+        return render_stats;
+    }
 
+    // reads and parses a glTF file and decodes its images; touches no renderer state, so any thread may call it.
+    // On failure error holds the loader's message and nothing is printed, so a worker can leave reporting to loadModel
+    static std::optional<tinygltf::Model> decodeModel(const std::string& filename, std::string& error) {
         tinygltf::Model model;
         tinygltf::TinyGLTF loader;
-        std::string err, warn;
-        bool ret = loader.LoadASCIIFromFile(&model, &err, &warn, filename);
+        loader.SetFsCallbacks(resourceFsCallbacks());
+        std::string warn;
+        bool ret = loader.LoadASCIIFromFile(&model, &error, &warn, filename);
+        if (!ret) {
+            return {};
+        }
         if (!warn.empty()) {
             printf("Warn: %s\n", warn.c_str());
         }
-        if (!err.empty()) {
-            printf("Err: %s\n", err.c_str());
+        if (!error.empty()) {
+            printf("Err: %s\n", error.c_str());
         }
-        if (!ret) {
-            printf("Failed to parse glTF\n");
-            exit(1);
+        return model;
+    }
+
+    // decodes a model ahead of time from a worker thread, loadModel then only has to upload it;
+    // returns the bytes of buffer and image data decoded, 0 if the model was already requested
+    size_t prefetchModel(const std::string& filename) {
+        DecodedModels& decoded = *decoded_models;
+        {
+            std::lock_guard<std::mutex> lock(decoded.mutex);
+            if (!decoded.requested.insert(filename).second) {
+                return 0;
+            }
+            decoded.in_progress.insert(filename);
+        }
+        std::string error;
+        std::optional<tinygltf::Model> model = decodeModel(filename, error);
+        if (!model.has_value()) {
+            // loadModel decodes it again on the main thread and reports the error there
+            {
+                std::lock_guard<std::mutex> lock(decoded.mutex);
+                decoded.requested.erase(filename);
+                decoded.in_progress.erase(filename);
+            }
+            decoded.done.notify_all();
+            return 0;
+        }
+        size_t bytes = 0;
+        for (const auto& buffer : model->buffers) {
+            bytes += buffer.data.size();
+        }
+        for (const auto& image : model->images) {
+            bytes += image.image.size();
+        }
+        {
+            std::lock_guard<std::mutex> lock(decoded.mutex);
+            decoded.ready.insert({ filename, std::move(*model) });
+            decoded.in_progress.erase(filename);
+        }
+        decoded.done.notify_all();
+        return bytes;
+    }
+
+    // hands over a model decoded elsewhere; ignored if the file was already loaded or prefetched
+    void addDecodedModel(const std::string& filename, tinygltf::Model model) {
+        DecodedModels& decoded = *decoded_models;
+        std::lock_guard<std::mutex> lock(decoded.mutex);
+        if (decoded.requested.insert(filename).second) {
+            decoded.ready.insert({ filename, std::move(model) });
+        }
+    }
+
+    // drops prefetched models that will not be uploaded after all; they are decoded again if something loads them later
+    void discardDecodedModels(const std::vector<std::string>& filenames) {
+        DecodedModels& decoded = *decoded_models;
+        std::lock_guard<std::mutex> lock(decoded.mutex);
+        for (const auto& filename : filenames) {
+            if (decoded.ready.erase(filename) != 0) {
+                decoded.requested.erase(filename);
+            }
+        }
+    }
+
+    bool isModelLoaded(const std::string& filename) const {
+        return model_types.find(filename) != model_types.end();
+    }
+
+    ModelHandle loadModel(std::string filename) {
+        if (model_types.find(filename) != model_types.end()) {
+            return model_types[filename];
+        }
+
+        tinygltf::Model model;
+        bool prefetched = false;
+        {
+            DecodedModels& decoded = *decoded_models;
+            std::unique_lock<std::mutex> lock(decoded.mutex);
+            decoded.done.wait(lock, [&] { return decoded.in_progress.count(filename) == 0; });
+            auto it = decoded.ready.find(filename);
+            if (it != decoded.ready.end()) {
+                model = std::move(it->second);
+                decoded.ready.erase(it);
+                prefetched = true;
+            }
+            // later prefetches of this file would only decode a model that is already uploaded
+            decoded.requested.insert(filename);
+        }
+        if (!prefetched) {
+            std::string error;
+            std::optional<tinygltf::Model> decoded_model = decodeModel(filename, error);
+            if (!decoded_model.has_value()) {
+                printf("Err: %s\n", error.c_str());
+                printf("Failed to parse glTF\n");
+                exit(1);
+            }
+            model = std::move(*decoded_model);
         }
         tinygltf::Scene& scene = model.scenes[model.defaultScene];
         if (scene.nodes.size() != 1) {
@@ -1508,24 +2444,16 @@ public:
             exit(1);
         }
 
-        std::string label = std::string("Instance transform buffer for ") + filename;
-        char* label_cstr = new char[label.size() + 1];
-        strncpy(label_cstr, label.c_str(), label.size() + 1);
-        std::cout << label_cstr << " " << label.size() << std::endl;
-        WGPUBufferDescriptor bufferDesc = {
-            .nextInChain = nullptr,
-            .label = label_cstr,
-            .usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex,
-            .size = 0,
-            .mappedAtCreation = false,
-        };
+        std::string label;
 
         WGPUBufferHolder model_uniform_buffer = {nullptr, voidDeleter};
         WGPUBindGroupHolder model_bind_group = {nullptr, voidDeleter};
+        glm::mat4x4 node_matrix(1.f);
         if (main_node.matrix.size() == 16) {
             ModelUniforms model_uniforms = {
                 .transform = glm::make_mat4x4(main_node.matrix.data()),
             };
+            node_matrix = model_uniforms.transform;
             label = "Model uniform buffer for " + filename;
             model_uniform_buffer = createModelUniformBuffer(label.c_str());
             wgpuQueueWriteBuffer(queue.get(), model_uniform_buffer.get(), 0, &model_uniforms, sizeof(ModelUniforms));
@@ -1546,6 +2474,7 @@ public:
             ModelUniforms model_uniform = {
                 .transform = model_transform.toMatrix(),
             };
+            node_matrix = model_uniform.transform;
             label = "Model uniform buffer for " + filename;
             model_uniform_buffer = createModelUniformBuffer(label.c_str());
             wgpuQueueWriteBuffer(queue.get(), model_uniform_buffer.get(), 0, &model_uniform, sizeof(ModelUniforms));
@@ -1556,12 +2485,19 @@ public:
             model_bind_group = {default_model_bind_group.get(), voidDeleter};
         }
 
+        uint32_t model_key = bindGroupKey(model_bind_group.get());
         ModelType model_type = {
             .primitives = {},
-            .transforms = DynamicTransformBuffer(device.get(), queue.get(), bufferDesc),
+            .transforms = DynamicTransformBuffer(instance_arena.get()),
+            .static_transforms = DynamicTransformBuffer(instance_arena.get()),
             .model_uniform_buffer = std::move(model_uniform_buffer),
             .model_bind_group = std::move(model_bind_group),
+            .model_key = model_key,
+            .bounds = {},
+            .bundle = {},
+            .static_bundle = {},
         };
+        Bounds mesh_bounds;
 
         for (int i = 0; i < mesh.primitives.size(); i++)  {
             auto& primitive = mesh.primitives[i];
@@ -1596,36 +2532,24 @@ public:
             assert(indicesAccessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT);
             assert(indicesAccessor.type == TINYGLTF_TYPE_SCALAR);
 
-            label = std::string("Position buffer for ") + filename;
-            WGPUBufferDescriptor bufferDesc = {
-                .nextInChain = nullptr,
-                .label = label.c_str(),
-                .usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex,
-                .size = positionBufferView.byteLength,
-                .mappedAtCreation = false,
-            };
-            WGPUBufferHolder positionBuffer = createBuffer(device.get(), bufferDesc);
-            wgpuQueueWriteBuffer(queue.get(), positionBuffer.get(), 0, modelPositionBuffer.data.data() + positionBufferView.byteOffset, bufferDesc.size);
-
-            label = std::string("Normal buffer for ") + filename;
-            bufferDesc.label = label.c_str();
-            bufferDesc.size = normalBufferView.byteLength;
-            WGPUBufferHolder normalBuffer = createBuffer(device.get(), bufferDesc);
-            wgpuQueueWriteBuffer(queue.get(), normalBuffer.get(), 0, modelNormalBuffer.data.data() + normalBufferView.byteOffset, bufferDesc.size);
-
-            // align indices buffer size to COPY_BUFFER_ALIGNMENT
-            uint32_t actual_byte_length = (indicesBufferView.byteLength + COPY_BUFFER_ALIGNMENT - 1) & ~(COPY_BUFFER_ALIGNMENT - 1);
-
-            label = std::string("Indices buffer for ") + filename;
-            bufferDesc.label = label.c_str();
-            bufferDesc.usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Index;
-            bufferDesc.size = actual_byte_length;
-            WGPUBufferHolder indicesBuffer = createBuffer(device.get(), bufferDesc);
-            std::cout << bufferDesc.size << std::endl;
-            wgpuQueueWriteBuffer(queue.get(), indicesBuffer.get(), 0, modelIndicesBuffer.data.data() + indicesBufferView.byteOffset, bufferDesc.size);
+            // glTF requires min/max on positions, but scan the data for exporters that leave them out
+            if (positionAccessor.minValues.size() == 3 && positionAccessor.maxValues.size() == 3) {
+                mesh_bounds.add(glm::vec3(positionAccessor.minValues[0], positionAccessor.minValues[1], positionAccessor.minValues[2]));
+                mesh_bounds.add(glm::vec3(positionAccessor.maxValues[0], positionAccessor.maxValues[1], positionAccessor.maxValues[2]));
+            } else {
+                const unsigned char* positions = modelPositionBuffer.data.data() + positionBufferView.byteOffset + positionAccessor.byteOffset;
+                for (size_t vertex = 0; vertex < positionAccessor.count; vertex++) {
+                    glm::vec3 position;
+                    std::memcpy(&position, positions + vertex * sizeof(glm::vec3), sizeof(glm::vec3));
+                    mesh_bounds.add(position);
+                }
+            }
 
-            // if no texcoords are present, position buffer is arbitrarily used since it is at least as big as the texcoord buffer would be
-            WGPUBufferHolder texcoord_buffer = {positionBuffer.get(), voidDeleter};
+            assert(normalAccessor.count == positionAccessor.count);
+            const glm::vec3* positions = reinterpret_cast<const glm::vec3*>(modelPositionBuffer.data.data() + positionBufferView.byteOffset + positionAccessor.byteOffset);
+            const glm::vec3* normals = reinterpret_cast<const glm::vec3*>(modelNormalBuffer.data.data() + normalBufferView.byteOffset + normalAccessor.byteOffset);
+            const uint16_t* indices = reinterpret_cast<const uint16_t*>(modelIndicesBuffer.data.data() + indicesBufferView.byteOffset + indicesAccessor.byteOffset);
+            const glm::vec2* texcoords = nullptr;
 
             glm::vec4 base_color = {1.f, 1.f, 1.f, 1.f};
             WGPUBufferHolder uniform_buffer = {default_primitive_uniform_buffer.get(), voidDeleter};
@@ -1674,12 +2598,8 @@ public:
                     assert(texcoordBufferView.byteStride == 8 || texcoordBufferView.byteStride == 0);
                     assert(texcoordAccessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
                     assert(texcoordAccessor.type == TINYGLTF_TYPE_VEC2);
-                    label = std::string("Texcoord buffer for ") + filename;
-                    bufferDesc.label = label.c_str();
-                    bufferDesc.usage = WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex;
-                    bufferDesc.size = texcoordBufferView.byteLength;
-                    texcoord_buffer = createBuffer(device.get(), bufferDesc);
-                    wgpuQueueWriteBuffer(queue.get(), texcoord_buffer.get(), 0, modelTexcoordBuffer.data.data() + texcoordBufferView.byteOffset, bufferDesc.size);
+                    assert(texcoordAccessor.count == positionAccessor.count);
+                    texcoords = reinterpret_cast<const glm::vec2*>(modelTexcoordBuffer.data.data() + texcoordBufferView.byteOffset + texcoordAccessor.byteOffset);
                 }
 
                 if (base_color != glm::vec4(1.f) || has_texture) {
@@ -1694,23 +2614,33 @@ public:
                 }
             }
 
-            label = std::string("Bind group for ") + filename;
-            WGPUBindGroupHolder bind_group = createPrimitiveBindGroup(label.c_str(), uniform_buffer.get(), color_view.get(), color_sampler.get());
+            // untextured primitives with the default color share one bind group, so drawing them back to back binds it once
+            WGPUBindGroupHolder bind_group = {default_primitive_bind_group.get(), voidDeleter};
+            if (uniform_buffer.get() != default_primitive_uniform_buffer.get()) {
+                label = std::string("Bind group for ") + filename;
+                bind_group = createPrimitiveBindGroup(label.c_str(), uniform_buffer.get(), color_view.get(), color_sampler.get());
+            }
+            uint32_t material_key = bindGroupKey(bind_group.get());
 
             model_type.primitives.push_back(ModelPrimitive {
-                .position_buffer = std::move(positionBuffer),
-                .normal_buffer = std::move(normalBuffer),
-                .index_buffer = std::move(indicesBuffer),
-                .texcoord_buffer = std::move(texcoord_buffer),
+                .geometry = geometry_arena->add(positions, normals, texcoords, positionAccessor.count, indices, indicesAccessor.count),
                 .uniform_buffer = std::move(uniform_buffer),
                 .texture = std::move(color),
                 .texture_view = std::move(color_view),
                 .sampler = std::move(color_sampler),
                 .bind_group = std::move(bind_group),
+                .material_key = material_key,
             });
             std::cout << "Loaded primitive " << i << std::endl;
         }
 
+        // a model without vertices draws nothing, so a point at the node's origin keeps the cull sphere finite
+        if (mesh_bounds.empty()) {
+            mesh_bounds.add(glm::vec3(0.f));
+        }
+        model_type.bounds = mesh_bounds.transformed(node_matrix);
+        std::cout << "Bounds: " << glm::to_string(model_type.bounds.min) << " to " << glm::to_string(model_type.bounds.max) << std::endl;
+
         models.push_back(std::move(model_type));
         ModelHandle handle = ModelHandle {models.size() - 1};
         model_types[filename] = handle;
@@ -1724,24 +2654,29 @@ public:
         presentFrame();
     }
 
-    InstanceHandle spawnInstance(ModelHandle model, Transform transform) {
+    // static instances may still be moved, but each move re-uploads part of the static buffer
+    InstanceHandle spawnInstance(ModelHandle model, Transform transform, bool is_static = false) {
         ModelType& model_data = models[model.index];
-        DynamicTransformBuffer::Index transform_index = model_data.transforms.add(transform);
-        return InstanceHandle {model, transform_index};
+        DynamicTransformBuffer& transforms = is_static ? model_data.static_transforms : model_data.transforms;
+        DynamicTransformBuffer::Index transform_index = transforms.add(transform);
+        return InstanceHandle {model, transform_index, is_static};
     }
 
     Transform& getModelInstance(InstanceHandle instance) {
         ModelType& model_data = models[instance.model.index];
-        return model_data.transforms[instance.transform_index];
+        DynamicTransformBuffer& transforms = instance.is_static ? model_data.static_transforms : model_data.transforms;
+        return transforms[instance.transform_index];
     }
 
     const Transform& getModelInstance(InstanceHandle instance) const {
         const ModelType& model_data = models[instance.model.index];
-        return model_data.transforms[instance.transform_index];
+        const DynamicTransformBuffer& transforms = instance.is_static ? model_data.static_transforms : model_data.transforms;
+        return transforms[instance.transform_index];
     }
 
     void destroyInstance(InstanceHandle instance) {
         ModelType& model_data = models[instance.model.index];
-        model_data.transforms.remove(instance.transform_index);
+        DynamicTransformBuffer& transforms = instance.is_static ? model_data.static_transforms : model_data.transforms;
+        transforms.remove(instance.transform_index);
     }
 };
@@ -3,7 +3,9 @@
 #include <algorithm>
 #include <functional>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <map>
 #include <optional>
 #include <queue>
 #include <stdlib.h>
@@ -11,7 +13,6 @@
 #include <thread>
 #include <sstream>
 
-#include "rapidjson/filereadstream.h"
 #include "source.h"
 
 #ifdef __EMSCRIPTEN__
@@ -55,11 +56,22 @@ int main(int argc, char** argv) {
 	lua_State* lua_state = luaL_newstate();
 	luaL_openlibs(lua_state);
 
-	if (!file_exists(translate_path("resources/"))) {
+	// resources.pack replaces the loose tree when present; --loose-files lets files on disk shadow its entries
+	bool loose_overlay = false;
+	for (int i = 1; i < argc; i++) {
+		loose_overlay |= std::string_view{ argv[i] } == "--loose-files";
+	}
+	ResourceFS::mount(translate_path("resources.pack"), base_path, loose_overlay);
+
+	if (!ResourceFS::mounted() && !file_exists(translate_path("resources/"))) {
 		std::cout << "error: resources/ missing" << std::endl;
 		return 0;
 	}
 
+	if (argc > 1 && std::string_view{ argv[1] } == "--precompile-components") {
+		return TemplateManager::precompile_components(lua_state);
+	}
+
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         std::cerr << "Could not initialize SDL! Error: " << SDL_GetError() << std::endl;
         exit(1);
@@ -67,6 +79,8 @@ int main(int argc, char** argv) {
 
 	std::shared_ptr<GameConfig> game_config = std::make_shared<GameConfig>();
 
+	// reads the initial scene's assets in the background while World creates the device and loads the scene
+	StartupPreloader preloader(game_config->initial_scene);
 	World world = { game_config, lua_state };
 
 	#ifdef __EMSCRIPTEN__
@@ -80,7 +94,47 @@ int main(int argc, char** argv) {
 
 
 bool file_exists(std::string_view path) {
-    return std::filesystem::exists(path);
+    return ResourceFS::exists(std::string(path));
+}
+
+static std::string read_file_bytes(const std::string& path, bool use_preloaded = true) {
+	if (use_preloaded) {
+		if (std::optional<std::string> preloaded = StartupPreloader::take_file(path)) {
+			return std::move(*preloaded);
+		}
+	}
+	std::optional<ResourceData> contents = ResourceFS::read(path);
+	return contents.has_value() ? contents->take() : std::string{};
+}
+
+static uint64_t hash_bytes(std::string_view bytes, uint64_t hash = 14695981039346656037ull) {
+	for (char c : bytes) {
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static std::filesystem::path bytecode_cache_path(const std::string& type, const std::string& source) {
+	uint64_t hash = hash_bytes(source, hash_bytes(LUA_VERSION_RELEASE));
+	std::stringstream cache_name;
+	cache_name << type << '.' << std::hex << hash << ".luac";
+	return std::filesystem::path(translate_path("cache/bytecode/")) / cache_name.str();
+}
+
+static int dump_chunk_writer(lua_State*, const void* data, size_t size, void* out) {
+	static_cast<std::string*>(out)->append(static_cast<const char*>(data), size);
+	return 0;
+}
+
+// compiles source (leaving the chunk on the stack) and returns its bytecode, or an empty string on a syntax error
+static std::string compile_chunk(lua_State* lua_state, const std::string& source, const std::string& chunk_name) {
+	if (luaL_loadbufferx(lua_state, source.data(), source.size(), chunk_name.c_str(), "t") != LUA_OK) {
+		return {};
+	}
+	std::string bytecode;
+	lua_dump(lua_state, dump_chunk_writer, &bytecode, 0);
+	return bytecode;
 }
 
 
@@ -129,7 +183,8 @@ GameConfig::GameConfig() {
 		std::cout << "error: resources/game.config missing";
 		exit(0);
 	}
-	rapidjson::Document doc = ReadJsonFile(translate_path("resources/game.config"));
+	JsonFile file(translate_path("resources/game.config"));
+	const rapidjson::Document& doc = file.doc();
 
 	std::optional<const char*> initial_scene = get_value<const char*>(doc, "initial_scene");
 	if (!initial_scene.has_value()) {
@@ -139,6 +194,44 @@ GameConfig::GameConfig() {
 	this->initial_scene = initial_scene.value();
 	window_name = get_string(doc, "game_title").value_or("");
 	font = get_string(doc, "font");
+	scene_load_budget_ms = get_number(doc, "scene_load_budget_ms").value_or(scene_load_budget_ms);
+	work_budget_ms = get_number(doc, "work_budget_ms").value_or(work_budget_ms);
+	work_max_wait_frames = std::max(get_value<int>(doc, "work_max_wait_frames").value_or(static_cast<int>(work_max_wait_frames)), 1);
+	preload_budget_mb = static_cast<size_t>(std::max(get_value<int>(doc, "preload_budget_mb").value_or(static_cast<int>(preload_budget_mb)), 0));
+
+	if (doc.HasMember("watchdog") && doc["watchdog"].IsObject()) {
+		const auto& watchdog_config = doc["watchdog"];
+		watchdog.enabled = true;
+		watchdog.call_instructions = get_value<uint64_t>(watchdog_config, "call_instructions").value_or(0);
+		watchdog.call_ms = get_number(watchdog_config, "call_ms").value_or(0.f);
+		watchdog.frame_instructions = get_value<uint64_t>(watchdog_config, "frame_instructions").value_or(0);
+		watchdog.frame_ms = get_number(watchdog_config, "frame_ms").value_or(0.f);
+		watchdog.check_interval = std::max(get_value<int>(watchdog_config, "check_interval").value_or(1000), 1);
+		std::string policy = get_string(watchdog_config, "policy").value_or("report");
+		if (policy == "abort") {
+			watchdog.policy = WatchdogPolicy::Abort;
+		} else if (policy == "disable") {
+			watchdog.policy = WatchdogPolicy::Disable;
+		} else if (policy == "report") {
+			watchdog.policy = WatchdogPolicy::Report;
+		} else {
+			std::cout << "error: unknown watchdog policy " << policy;
+			exit(0);
+		}
+	}
+
+	if (doc.HasMember("streaming") && doc["streaming"].IsObject()) {
+		const auto& streaming_config = doc["streaming"];
+		if (streaming_config.HasMember("scenes") && streaming_config["scenes"].IsArray()) {
+			for (const auto& scene : streaming_config["scenes"].GetArray()) {
+				if (scene.IsString()) {
+					streaming.scenes.insert(scene.GetString());
+				}
+			}
+		}
+		streaming.load_radius = std::max(get_value<int>(streaming_config, "load_radius").value_or(streaming.load_radius), 0);
+		streaming.unload_radius = std::max(get_value<int>(streaming_config, "unload_radius").value_or(streaming.load_radius + 1), streaming.load_radius);
+	}
 }
 
 
@@ -170,6 +263,37 @@ void Actor::remove_sorted(std::vector<ComponentIndex>& v, ComponentIndex e) {
 	}
 }
 
+void Actor::link_callbacks(ComponentIndex index) {
+	const luabridge::LuaRef& lua_component = components[index].lua_component;
+	if (!lua_component["OnUpdate"].isNil()) {
+		insert_sorted(have_update, index);
+	}
+	if (!lua_component["OnLateUpdate"].isNil()) {
+		insert_sorted(have_late_update, index);
+	}
+	if (!lua_component["OnCollisionEnter"].isNil()) {
+		insert_sorted(have_on_collision_enter, index);
+	}
+	if (!lua_component["OnCollisionExit"].isNil()) {
+		insert_sorted(have_on_collision_exit, index);
+	}
+	if (!lua_component["OnTriggerEnter"].isNil()) {
+		insert_sorted(have_on_trigger_enter, index);
+	}
+	if (!lua_component["OnTriggerExit"].isNil()) {
+		insert_sorted(have_on_trigger_exit, index);
+	}
+}
+
+void Actor::unlink_callbacks(ComponentIndex index) {
+	remove_sorted(have_update, index);
+	remove_sorted(have_late_update, index);
+	remove_sorted(have_on_collision_enter, index);
+	remove_sorted(have_on_collision_exit, index);
+	remove_sorted(have_on_trigger_enter, index);
+	remove_sorted(have_on_trigger_exit, index);
+}
+
 Component& Actor::add_component(Component new_component) {
 	ComponentIndex index = 0;
 	if (!free_list.empty()) {
@@ -183,23 +307,26 @@ Component& Actor::add_component(Component new_component) {
 	Component& component = components[index];
 	keys[component.key] = index;
 	insert_sorted(types[component.type], index);
-	if (!component.lua_component["OnUpdate"].isNil()) {
-		insert_sorted(have_update, index);
-	}
-	if (!component.lua_component["OnLateUpdate"].isNil()) {
-		insert_sorted(have_late_update, index);
-	}
-	if (!component.lua_component["OnCollisionEnter"].isNil()) {
-		insert_sorted(have_on_collision_enter, index);
-	}
-	if (!component.lua_component["OnCollisionExit"].isNil()) {
-		insert_sorted(have_on_collision_exit, index);
-	}
-	if (!component.lua_component["OnTriggerEnter"].isNil()) {
-		insert_sorted(have_on_trigger_enter, index);
+
+	// enabled is owned by the engine from here on; dropping the instance's own value routes later writes through
+	// __newindex, and reads come from the metatable set_instance_enabled picks
+	if (component.lua_component.isTable()) {
+		lua_State* lua_state = component.lua_component.state();
+		component.lua_component.push();
+		lua_getfield(lua_state, -1, "enabled");
+		component.enabled = lua_isnil(lua_state, -1) || lua_toboolean(lua_state, -1);
+		lua_pop(lua_state, 1);
+		lua_pushliteral(lua_state, "enabled");
+		lua_pushnil(lua_state);
+		lua_rawset(lua_state, -3);
+		set_instance_enabled(lua_state, -1, component.enabled);
+		lua_pop(lua_state, 1);
+	} else {
+		luabridge::LuaRef enabled = component.lua_component["enabled"];
+		component.enabled = enabled.isNil() || enabled.cast<bool>();
 	}
-	if (!component.lua_component["OnTriggerExit"].isNil()) {
-		insert_sorted(have_on_trigger_exit, index);
+	if (component.enabled) {
+		link_callbacks(index);
 	}
 	needs_destroy += static_cast<uint32_t>(!component.lua_component["OnDestroy"].isNil());
 	return component;
@@ -219,19 +346,34 @@ void Actor::remove_component(std::string key, bool force) {
 	if (type_list.empty()) {
 		types.erase(component.type);
 	}
-	remove_sorted(have_update, index);
-	remove_sorted(have_late_update, index);
-	remove_sorted(have_on_collision_enter, index);
-	remove_sorted(have_on_collision_exit, index);
-	remove_sorted(have_on_trigger_enter, index);
-	remove_sorted(have_on_trigger_exit, index);
+	unlink_callbacks(index);
 
 	component.lua_component = luabridge::LuaRef(component.lua_component.state());
 	component.key = "Erased Key";
 	component.type = "Erased Type";
+	component.enabled = true;
+	component.type_slot = numeric_max<uint32_t>();
 	free_list.push_back(index);
 }
 
+void Actor::set_enabled(ComponentIndex index, bool enabled) {
+	Component& component = components[index];
+	if (component.enabled == enabled) {
+		return;
+	}
+	component.enabled = enabled;
+	if (component.lua_component.isTable()) {
+		component.lua_component.push();
+		set_instance_enabled(component.lua_component.state(), -1, enabled);
+		lua_pop(component.lua_component.state(), 1);
+	}
+	if (enabled) {
+		link_callbacks(index);
+	} else {
+		unlink_callbacks(index);
+	}
+}
+
 void Actor::clear() {
 	to_destroy.clear();
 	if (needs_destroy != 0) {
@@ -256,37 +398,66 @@ void Actor::clear() {
 
 	free_list.clear();
 	id = numeric_max<ActorId>();
+	active = true;
 }
 
 void Actor::call_destroy() {
 	for (ComponentIndex i : to_destroy) {
 		luabridge::LuaRef component = components[i].lua_component;
+		ScriptWatchdog* watchdog = ScriptWatchdog::from(component.state());
+		if (watchdog != nullptr) {
+			watchdog->begin_call(name, components[i].type, "OnDestroy");
+		}
 		sandbox_call(component["OnDestroy"], name, component);
+		if (watchdog != nullptr) {
+			watchdog->end_call();
+		}
 		remove_component(components[i].key, true);
 		needs_destroy -= 1;
 	}
 	to_destroy.clear();
 }
 
-static rapidjson::Document ReadJsonFile(const std::string &path)
-{
-    FILE* file_pointer = nullptr;
-	rapidjson::Document out_document;
-#ifdef _WIN32
-	fopen_s(&file_pointer, path.c_str(), "rb");
-#else
-	file_pointer = fopen(path.c_str(), "rb");
-#endif
-	char buffer[65536];
-	rapidjson::FileReadStream stream(file_pointer, buffer, sizeof(buffer));
-	out_document.ParseStream(stream);
-	std::fclose(file_pointer);
+std::vector<std::unique_ptr<JsonFile::Arena>>& JsonFile::spare_arenas() {
+	thread_local std::vector<std::unique_ptr<Arena>> spare;
+	return spare;
+}
+
+std::unique_ptr<JsonFile::Arena> JsonFile::take_arena(bool pooled) {
+	auto& spare = spare_arenas();
+	if (!pooled || spare.empty()) {
+		return std::make_unique<Arena>();
+	}
+	std::unique_ptr<Arena> arena = std::move(spare.back());
+	spare.pop_back();
+	return arena;
+}
+
+JsonFile::JsonFile(const std::string& path, bool pooled) : pooled(pooled), arena(take_arena(pooled)), document(&arena->allocator) {
+	std::optional<ResourceData> contents = ResourceFS::read(path);
+	if (!contents.has_value()) {
+		std::cout << "error: could not open [" << path << "]" << std::endl;
+		exit(0);
+	}
+	// ParseInsitu needs a writable, null terminated copy; the text buffer keeps its capacity between files
+	std::span<const char> bytes = contents->bytes();
+	arena->text.assign(bytes.begin(), bytes.end());
+	arena->text.push_back('\0');
 
-	if (out_document.HasParseError()) {
+	document.ParseInsitu(arena->text.data());
+	if (document.HasParseError()) {
 		std::cout << "error parsing json at [" << path << "]" << std::endl;
 		exit(0);
 	}
-	return out_document;
+}
+
+JsonFile::~JsonFile() {
+	// pool allocated values are never freed individually; clearing keeps the arena's first block for the next file
+	document.SetNull();
+	arena->allocator.Clear();
+	if (pooled) {
+		spare_arenas().push_back(std::move(arena));
+	}
 }
 
 template<typename T>
@@ -351,34 +522,204 @@ luabridge::LuaRef get_value(lua_State* lua_state, const rapidjson::Value& val, c
 	return get_value(lua_state, val[key]);
 }
 
-luabridge::LuaRef get_value(lua_State* lua_state, const rapidjson::Value& val) {
+static void push_value(lua_State* lua_state, const rapidjson::Value& val) {
 	if (val.IsArray()) {
-		luabridge::LuaRef ref = luabridge::newTable(lua_state);
-		for (auto it = val.Begin(); it != val.End(); it++) {
-			ref.append(get_value(lua_state, *it));
+		lua_createtable(lua_state, static_cast<int>(val.Size()), 0);
+		for (rapidjson::SizeType i = 0; i < val.Size(); i++) {
+			push_value(lua_state, val[i]);
+			lua_rawseti(lua_state, -2, static_cast<lua_Integer>(i) + 1);
+		}
+	} else if (val.IsBool()) {
+		lua_pushboolean(lua_state, val.Get<bool>());
+	} else if (val.IsInt()) {
+		lua_pushinteger(lua_state, val.Get<int32_t>());
+	} else if (val.IsNumber()) {
+		lua_pushnumber(lua_state, val.Get<float>());
+	} else if (val.IsObject()) {
+		lua_createtable(lua_state, 0, static_cast<int>(val.MemberCount()));
+		for (auto it = val.MemberBegin(); it != val.MemberEnd(); it++) {
+			push_value(lua_state, it->value);
+			lua_setfield(lua_state, -2, it->name.GetString());
+		}
+	} else if (val.IsString()) {
+		lua_pushlstring(lua_state, val.GetString(), val.GetStringLength());
+	} else {
+		lua_pushnil(lua_state);
+	}
+}
+
+luabridge::LuaRef get_value(lua_State* lua_state, const rapidjson::Value& val) {
+	push_value(lua_state, val);
+	return luabridge::LuaRef::fromStack(lua_state);
+}
+
+// open() has already rejected cyclic and overly deep values; the depth check only guards against that changing
+static void push_value(lua_State* lua_state, const cooked::File& file, const cooked::Value& val, uint32_t depth = 1) {
+	if (depth > cooked::max_depth) {
+		luaL_error(lua_state, "%s: values nested deeper than %d", file.path().c_str(), static_cast<int>(cooked::max_depth));
+	}
+	luaL_checkstack(lua_state, 2, "cooked value");
+	switch (val.type) {
+	case cooked::ValueType::Array:
+		lua_createtable(lua_state, static_cast<int>(val.count), 0);
+		for (uint32_t i = 0; i < val.count; i++) {
+			push_value(lua_state, file, file.value(val.index + i), depth + 1);
+			lua_rawseti(lua_state, -2, static_cast<lua_Integer>(i) + 1);
 		}
-		return ref;
+		break;
+	case cooked::ValueType::Bool:
+		lua_pushboolean(lua_state, val.boolean != 0);
+		break;
+	case cooked::ValueType::Int:
+		lua_pushinteger(lua_state, val.integer);
+		break;
+	case cooked::ValueType::Number:
+		lua_pushnumber(lua_state, val.number);
+		break;
+	case cooked::ValueType::Object:
+		lua_createtable(lua_state, 0, static_cast<int>(val.count));
+		for (uint32_t i = 0; i < val.count; i++) {
+			const cooked::Field& field = file.field(val.index + i);
+			push_value(lua_state, file, file.value(field.value), depth + 1);
+			lua_setfield(lua_state, -2, file.c_str(field.name));
+		}
+		break;
+	case cooked::ValueType::String: {
+		std::string_view string = file.string(val.index);
+		lua_pushlstring(lua_state, string.data(), string.size());
+		break;
+	}
+	default:
+		lua_pushnil(lua_state);
+		break;
 	}
-	if (val.IsBool()) {
-		return luabridge::LuaRef(lua_state, val.Get<bool>());
+}
+
+// whether source_path was edited after the cooked file at cooked_path was written
+static bool edited_after_cooking(const std::string& source_path, const std::string& cooked_path) {
+	std::error_code error;
+	// pack entries carry no timestamps; a packed cooked file only loses to a loose source shadowing the pack
+	if (ResourceFS::packed(cooked_path)) {
+		return ResourceFS::packed(source_path) == nullptr && std::filesystem::exists(source_path, error);
 	}
-	if (val.IsInt()) {
-		return luabridge::LuaRef(lua_state, val.Get<int32_t>());
+	if (ResourceFS::packed(source_path) || !std::filesystem::exists(source_path, error)) {
+		return false;
 	}
-	if (val.IsNumber()) {
-		return luabridge::LuaRef(lua_state, val.Get<float>());
+	return std::filesystem::last_write_time(cooked_path, error) < std::filesystem::last_write_time(source_path, error);
+}
+
+// the cooked copy (path + "c") is used when present, unless the JSON source was edited after cooking
+static bool prefer_cooked(const std::string& source_path) {
+	const std::string cooked_path = source_path + "c";
+	return ResourceFS::exists(cooked_path) && !edited_after_cooking(source_path, cooked_path);
+}
+
+// a cooked scene embeds the templates its actors use, so editing one of them makes the scene stale too
+static bool cooked_dependencies_current(const cooked::File& file) {
+	for (uint32_t i = 0; i < file.dependency_count(); i++) {
+		if (edited_after_cooking(translate_path("resources/actor_templates/") + std::string{ file.dependency(i) } + ".template", file.path())) {
+			return false;
+		}
 	}
-	if (val.IsObject()) {
-		luabridge::LuaRef ref = luabridge::newTable(lua_state);
-		for (auto it = val.MemberBegin(); it != val.MemberEnd(); it++) {
-			ref[it->name.GetString()] = get_value(lua_state, it->value);
+	return true;
+}
+
+// component types, templates and prototypes are their own __index, so the VM walks the chain without calling out
+static void set_component_index(lua_State* lua_state, int index) {
+	index = lua_absindex(lua_state, index);
+	lua_pushliteral(lua_state, "__index");
+	lua_pushvalue(lua_state, index);
+	lua_rawset(lua_state, index);
+}
+
+static luabridge::LuaRef make_instance(const luabridge::LuaRef& parent) {
+	lua_State* lua_state = parent.state();
+	lua_createtable(lua_state, 0, 2); // key and actor
+	parent.push(lua_state);
+	lua_setmetatable(lua_state, -2);
+	return luabridge::LuaRef::fromStack(lua_state);
+}
+
+// __newindex for component types and templates: `component.enabled = x` on an attached component goes to Actor:SetEnabled
+static int component_newindex(lua_State* lua_state) {
+	if (lua_type(lua_state, 2) == LUA_TSTRING && std::string_view{ lua_tostring(lua_state, 2) } == "enabled") {
+		lua_pushliteral(lua_state, "actor");
+		if (lua_rawget(lua_state, 1) != LUA_TNIL) {
+			lua_getfield(lua_state, -1, "SetEnabled");
+			lua_insert(lua_state, -2);
+			lua_pushvalue(lua_state, 1);
+			lua_pushboolean(lua_state, lua_toboolean(lua_state, 3));
+			lua_call(lua_state, 3, 0);
+			return 0;
 		}
-		return ref;
+		lua_pop(lua_state, 1);
+	}
+	lua_settop(lua_state, 3);
+	lua_rawset(lua_state, 1);
+	return 0;
+}
+
+// the registry's parent -> toggle table, and the key a toggle keeps its parent under
+static const char enabled_toggle_key = 0;
+
+static bool inherited_enabled(lua_State* lua_state, int index) {
+	lua_getfield(lua_state, index, "enabled");
+	bool enabled = lua_isnil(lua_state, -1) || lua_toboolean(lua_state, -1);
+	lua_pop(lua_state, 1);
+	return enabled;
+}
+
+// replaces the parent on top of the stack with its toggle: a table over the parent that only flips enabled, made once
+static void push_enabled_toggle(lua_State* lua_state) {
+	if (lua_rawgetp(lua_state, LUA_REGISTRYINDEX, &enabled_toggle_key) == LUA_TNIL) {
+		lua_pop(lua_state, 1);
+		lua_newtable(lua_state);
+		lua_createtable(lua_state, 0, 1);
+		lua_pushliteral(lua_state, "k");
+		lua_setfield(lua_state, -2, "__mode");
+		lua_setmetatable(lua_state, -2);
+		lua_pushvalue(lua_state, -1);
+		lua_rawsetp(lua_state, LUA_REGISTRYINDEX, &enabled_toggle_key);
+	}
+	lua_pushvalue(lua_state, -2);
+	if (lua_rawget(lua_state, -2) == LUA_TNIL) {
+		lua_pop(lua_state, 1);
+		lua_createtable(lua_state, 0, 4);
+		lua_pushboolean(lua_state, !inherited_enabled(lua_state, -3));
+		lua_setfield(lua_state, -2, "enabled");
+		lua_pushvalue(lua_state, -1);
+		lua_setfield(lua_state, -2, "__index");
+		lua_pushcfunction(lua_state, &component_newindex);
+		lua_setfield(lua_state, -2, "__newindex");
+		lua_pushvalue(lua_state, -3);
+		lua_rawsetp(lua_state, -2, &enabled_toggle_key);
+		lua_pushvalue(lua_state, -3);
+		lua_setmetatable(lua_state, -2);
+		lua_pushvalue(lua_state, -3);
+		lua_pushvalue(lua_state, -2);
+		lua_rawset(lua_state, -4);
+	}
+	lua_replace(lua_state, -3);
+	lua_pop(lua_state, 1);
+}
+
+// An instance inherits enabled from its type, template or prototype while the engine's flag matches it; otherwise its
+// metatable is that parent's toggle. Reads stay plain table lookups, and writes still reach __newindex because the
+// instance itself never holds enabled.
+void set_instance_enabled(lua_State* lua_state, int index, bool enabled) {
+	index = lua_absindex(lua_state, index);
+	if (!lua_getmetatable(lua_state, index)) {
+		return;
+	}
+	if (lua_rawgetp(lua_state, -1, &enabled_toggle_key) != LUA_TNIL) {
+		lua_replace(lua_state, -2);
+	} else {
+		lua_pop(lua_state, 1);
 	}
-	if (val.IsString()) {
-		return luabridge::LuaRef(lua_state, val.GetString());
+	if (inherited_enabled(lua_state, -1) != enabled) {
+		push_enabled_toggle(lua_state);
 	}
-	return luabridge::LuaRef(lua_state);
+	lua_setmetatable(lua_state, index);
 }
 
 void set_metatable(const luabridge::LuaRef& base, const luabridge::LuaRef& meta) {
@@ -393,13 +734,16 @@ RenderConfig::RenderConfig() {
 	if (!file_exists(translate_path("resources/rendering.config"))) {
 		return;
 	}
-	rapidjson::Document config = ReadJsonFile(translate_path("resources/rendering.config"));
+	JsonFile file(translate_path("resources/rendering.config"));
+	const rapidjson::Document& config = file.doc();
 	size.x = get_value<int>(config, "x_resolution").value_or(size.x);
 	size.y = get_value<int>(config, "y_resolution").value_or(size.y);
 	clear_color.r = static_cast<uint8_t>(get_value<int>(config, "clear_color_r").value_or(255));
 	clear_color.g = static_cast<uint8_t>(get_value<int>(config, "clear_color_g").value_or(255));
 	clear_color.b = static_cast<uint8_t>(get_value<int>(config, "clear_color_b").value_or(255));
 	zoom = get_number(config, "zoom_factor").value_or(1.f);
+	cull_min_pixels = get_number(config, "cull_min_pixels").value_or(0.f);
+	render_bundles = get_value<bool>(config, "render_bundles").value_or(true);
 }
 
 
@@ -420,33 +764,107 @@ void TemplateManager::load_component(std::string type) {
 		components.insert({ type, luabridge::LuaRef(lua_state) });
 		return;
 	}
-	const std::string filetype = translate_path("resources/component_types/") + type + ".lua";
-	if (!file_exists(filetype)) {
-		std::cout << "error: failed to locate component " << type;
-		exit(0);
-	}
-	if (luaL_dofile(lua_state, filetype.c_str()) != LUA_OK) {
+	if (!load_component_chunk(type) || lua_pcall(lua_state, 0, 0, 0) != LUA_OK) {
 		std::cout << "problem with lua file " << type;
 		exit(0);
 	}
 	luabridge::LuaRef meta = luabridge::getGlobal(lua_state, type.c_str());
-	meta["__index"] = meta;
+	luabridge::LuaRef coroutine = luabridge::getGlobal(lua_state, "Coroutine");
+	meta.push();
+	set_component_index(lua_state, -1);
+	lua_pop(lua_state, 1);
+	meta["__newindex"] = &component_newindex;
 	meta["enabled"] = true;
+	meta["StartCoroutine"] = coroutine["Start"].cast<luabridge::LuaRef>();
 	components.insert({ type, meta });
 }
 
+// Pushes the compiled chunk for a component type. Sources are compiled once and cached as bytecode under
+// cache/bytecode/, keyed by content hash and Lua version; shipped builds may contain only precompiled .luac files.
+bool TemplateManager::load_component_chunk(const std::string& type) {
+	const std::string source_path = translate_path("resources/component_types/") + type + ".lua";
+	const std::string chunk_name = "@" + source_path;
+	if (!file_exists(source_path)) {
+		const std::string bytecode_path = translate_path("resources/component_types/") + type + ".luac";
+		if (!file_exists(bytecode_path)) {
+			std::cout << "error: failed to locate component " << type;
+			exit(0);
+		}
+		std::string bytecode = read_file_bytes(bytecode_path);
+		return luaL_loadbufferx(lua_state, bytecode.data(), bytecode.size(), chunk_name.c_str(), "b") == LUA_OK;
+	}
+
+	std::string source = read_file_bytes(source_path);
+	const std::filesystem::path cache_path = bytecode_cache_path(type, source);
+
+	std::error_code error;
+	if (std::filesystem::exists(cache_path, error)) {
+		std::string bytecode = read_file_bytes(cache_path.string());
+		if (luaL_loadbufferx(lua_state, bytecode.data(), bytecode.size(), chunk_name.c_str(), "b") == LUA_OK) {
+			return true;
+		}
+		lua_pop(lua_state, 1);
+	}
+
+	std::string bytecode = compile_chunk(lua_state, source, chunk_name);
+	if (bytecode.empty()) {
+		std::cout << lua_tostring(lua_state, -1) << std::endl;
+		lua_pop(lua_state, 1);
+		return false;
+	}
+	std::filesystem::create_directories(cache_path.parent_path(), error);
+	std::ofstream(cache_path, std::ios::binary).write(bytecode.data(), static_cast<std::streamsize>(bytecode.size()));
+	return true;
+}
+
+int TemplateManager::precompile_components(lua_State* lua_state) {
+	int failures = 0;
+	std::error_code error;
+	for (const auto& entry : std::filesystem::directory_iterator(translate_path("resources/component_types/"), error)) {
+		if (entry.path().extension() != ".lua") {
+			continue;
+		}
+		std::filesystem::path output = entry.path();
+		output.replace_extension(".luac");
+		std::string bytecode = compile_chunk(lua_state, read_file_bytes(entry.path().string()), "@" + entry.path().string());
+		if (bytecode.empty()) {
+			std::cout << "error: " << lua_tostring(lua_state, -1) << std::endl;
+			failures += 1;
+		} else {
+			std::ofstream(output, std::ios::binary).write(bytecode.data(), static_cast<std::streamsize>(bytecode.size()));
+			std::cout << "Compiled " << output.string() << std::endl;
+		}
+		lua_pop(lua_state, 1);
+	}
+	return failures;
+}
+
 void TemplateManager::load_template(std::string name) {
 	if (templates.find(name) != templates.end()) {
 		return;
 	}
 	const std::string filename = translate_path("resources/actor_templates/") + name + ".template";
+	Actor templ;
+
+	cooked::File cooked_template;
+	if (prefer_cooked(filename) && cooked_template.open(filename + "c") && cooked_template.header().kind == cooked::Kind::Template && cooked_template.actor_count() == 1) {
+		const cooked::Actor& record = cooked_template.actor(0);
+		templ.name = cooked_template.string(record.name);
+		for (uint32_t i = 0; i < record.components.count; i++) {
+			const cooked::Component& component = cooked_template.component(record.components.offset + i);
+			add_template_component(templ, std::string{ cooked_template.string(component.key) }, std::string{ cooked_template.string(component.type) }, cooked_fields(cooked_template, component.fields));
+		}
+		templates.insert({ name, templ });
+		return;
+	}
+
 	if (!file_exists(filename)) {
 		std::cout << "error: template " << name << " is missing";
 		exit(0);
 	}
-	rapidjson::Document doc = ReadJsonFile(filename);
+	JsonFile file(filename);
+	const rapidjson::Document& doc = file.doc();
 
-	Actor templ;
 	templ.name = get_value<const char*>(doc, "name").value_or("");
 
 	if (!doc.HasMember("components")) {
@@ -464,23 +882,100 @@ void TemplateManager::load_template(std::string name) {
 	for (auto& key : keys) {
 		const auto& component = components[key.c_str()];
 		std::string type = component["type"].GetString();
-		luabridge::LuaRef lua_component = make_template_component(type);
-		templ.keys.insert({ key, static_cast<ComponentIndex>(templ.components.size()) });
-		Component new_component = { lua_component, std::move(key), std::move(type) };
-		for (auto it = component.MemberBegin(); it != component.MemberEnd(); it++) {
-			if (it->name == "type") {
-				continue;
-			}
-			new_component.lua_component[it->name.GetString()] = get_value(lua_state, it->value);
-		}
-		new_component.lua_component["__index"] = new_component.lua_component;
-		templ.components.push_back(new_component);
+		add_template_component(templ, std::move(key), std::move(type), json_fields(&component));
 	}
 
 	templates.insert({ name, templ });
 	return;
 }
 
+void TemplateManager::add_template_component(Actor& templ, std::string key, std::string type, const ComponentFields& fields) {
+	luabridge::LuaRef lua_component = make_template_component(type);
+	templ.keys.insert({ key, static_cast<ComponentIndex>(templ.components.size()) });
+	if (fields.count != 0) {
+		fields.for_each([&](const char* name) {
+			lua_component[name] = luabridge::LuaRef::fromStack(lua_state);
+		});
+	}
+	if (lua_component.isTable()) {
+		lua_component.push();
+		set_component_index(lua_state, -1);
+		lua_pop(lua_state, 1);
+		lua_component["__newindex"] = &component_newindex;
+	} else {
+		lua_component["__index"] = lua_component;
+	}
+	templ.components.push_back({ lua_component, std::move(key), std::move(type) });
+}
+
+// a hash of a DOM subtree's structure and contents, for deduplicating override objects without serializing them
+static uint64_t hash_json(const rapidjson::Value& value, uint64_t hash = hash_bytes("")) {
+	auto mix = [&](const auto& data) { hash = hash_bytes({ reinterpret_cast<const char*>(&data), sizeof(data) }, hash); };
+	mix(value.GetType());
+	if (value.IsNumber()) {
+		mix(value.IsInt());
+		mix(value.GetDouble());
+	} else if (value.IsString()) {
+		mix(value.GetStringLength());
+		hash = hash_bytes({ value.GetString(), value.GetStringLength() }, hash);
+	} else if (value.IsArray()) {
+		mix(value.Size());
+		for (const auto& element : value.GetArray()) {
+			hash = hash_json(element, hash);
+		}
+	} else if (value.IsObject()) {
+		mix(value.MemberCount());
+		for (auto it = value.MemberBegin(); it != value.MemberEnd(); it++) {
+			hash = hash_json(it->name, hash);
+			hash = hash_json(it->value, hash);
+		}
+	}
+	return hash;
+}
+
+TemplateManager::ComponentFields TemplateManager::json_fields(const rapidjson::Value* component) const {
+	ComponentFields fields;
+	if (component == nullptr) {
+		return fields;
+	}
+	for (auto it = component->MemberBegin(); it != component->MemberEnd(); it++) {
+		fields.count += static_cast<int>(std::string_view{ it->name.GetString() } != "type");
+	}
+	if (fields.count == 0) {
+		return fields;
+	}
+	std::stringstream id;
+	id << "json:" << std::hex << hash_json(*component);
+	fields.id = id.str();
+	fields.for_each = [lua_state = lua_state, component](const std::function<void(const char*)>& consume) {
+		for (auto it = component->MemberBegin(); it != component->MemberEnd(); it++) {
+			if (std::string_view{ it->name.GetString() } != "type") {
+				push_value(lua_state, it->value);
+				consume(it->name.GetString());
+			}
+		}
+	};
+	return fields;
+}
+
+// the cooker shares one field range between identical overrides, so the range identifies the content
+TemplateManager::ComponentFields TemplateManager::cooked_fields(const cooked::File& file, cooked::Section section) const {
+	ComponentFields fields;
+	fields.count = static_cast<int>(section.count);
+	if (fields.count == 0) {
+		return fields;
+	}
+	// the stamp keeps a re-cooked file from reusing prototypes built from its previous contents
+	fields.id = file.path() + '@' + std::to_string(file.stamp()) + '#' + std::to_string(section.offset);
+	fields.for_each = [lua_state = lua_state, &file, section](const std::function<void(const char*)>& consume) {
+		for (uint32_t i = 0; i < section.count; i++) {
+			const cooked::Field& field = file.field(section.offset + i);
+			push_value(lua_state, file, file.value(field.value));
+			consume(file.c_str(field.name));
+		}
+	};
+	return fields;
+}
 
 void Model::on_start(lua_State* lua_state) {
 	on_update(lua_state); // Just run update early
@@ -488,15 +983,28 @@ void Model::on_start(lua_State* lua_state) {
 
 void Model::on_update(lua_State* lua_state) {
 	if (mesh_dirty) {
-		if (instance.has_value()) {
-			on_destroy(lua_state);
-		}
 		Renderer* renderer = luabridge::getGlobal(lua_state, "_Renderer").cast<Renderer*>();
-		ModelHandle model = renderer->loadModel(translate_path("resources/meshes/") + mesh);
-		instance = {renderer->spawnInstance(model, transform)};
-		transform_dirty = false;
-		mesh_dirty = false;
-	} else if (transform_dirty) {
+		std::string path = translate_path("resources/meshes/") + mesh;
+		if (renderer->isModelLoaded(path)) {
+			if (instance.has_value()) {
+				on_destroy(lua_state);
+			}
+			instance = {renderer->spawnInstance(renderer->loadModel(path), transform, is_static)};
+			transform_dirty = false;
+			mesh_dirty = false;
+			return;
+		}
+		// uploading a mesh the first time is left to the work scheduler; any previous mesh stays up until it is done
+		WorkScheduler* work = luabridge::getGlobal(lua_state, "_WorkScheduler").cast<WorkScheduler*>();
+		work->enqueue({
+			.run = [renderer, path]() { renderer->loadModel(path); },
+			.priority = WorkScheduler::Priority::Normal,
+			.deadline = std::nullopt,
+			.owner = std::nullopt,
+			.key = path,
+		});
+	}
+	if (transform_dirty && instance.has_value()) {
 		Renderer* renderer = luabridge::getGlobal(lua_state, "_Renderer").cast<Renderer*>();
 		renderer->getModelInstance(instance.value()) = transform;
 		transform_dirty = false;
@@ -512,6 +1020,87 @@ void Model::on_destroy(lua_State* lua_state) {
 	instance = {};
 }
 
+void Model::write_transform(Renderer* renderer) {
+	if (instance.has_value() && !mesh_dirty) {
+		renderer->getModelInstance(instance.value()) = transform;
+		transform_dirty = false;
+	} else {
+		transform_dirty = true;
+	}
+}
+
+int Model::set_transforms(lua_State* lua_state) {
+	luaL_checktype(lua_state, 1, LUA_TTABLE);
+	luaL_checktype(lua_state, 2, LUA_TTABLE);
+	lua_Integer count = static_cast<lua_Integer>(lua_rawlen(lua_state, 1));
+	lua_Integer transform_count = static_cast<lua_Integer>(lua_rawlen(lua_state, 2));
+	if (transform_count != count) {
+		return luaL_error(lua_state, "SetTransforms: got %d models but %d transforms", static_cast<int>(count), static_cast<int>(transform_count));
+	}
+	Renderer* renderer = luabridge::getGlobal(lua_state, "_Renderer").cast<Renderer*>();
+	for (lua_Integer i = 1; i <= count; i++) {
+		lua_rawgeti(lua_state, 1, i);
+		lua_rawgeti(lua_state, 2, i);
+		Model* model = luabridge::Stack<Model*>::get(lua_state, -2);
+		const Transform* transform = luabridge::Stack<const Transform*>::get(lua_state, -1);
+		if (model != nullptr && transform != nullptr) {
+			model->transform = *transform;
+			model->write_transform(renderer);
+		}
+		lua_pop(lua_state, 2);
+	}
+	return 0;
+}
+
+// positions is either an array of vec3 or a flat array of x, y, z numbers
+int Model::set_translations(lua_State* lua_state) {
+	luaL_checktype(lua_state, 1, LUA_TTABLE);
+	luaL_checktype(lua_state, 2, LUA_TTABLE);
+	lua_Integer count = static_cast<lua_Integer>(lua_rawlen(lua_state, 1));
+	lua_Integer position_count = static_cast<lua_Integer>(lua_rawlen(lua_state, 2));
+	lua_rawgeti(lua_state, 2, 1);
+	bool flat = lua_type(lua_state, -1) == LUA_TNUMBER;
+	lua_pop(lua_state, 1);
+	if (position_count != (flat ? count * 3 : count)) {
+		return luaL_error(lua_state, "SetTranslations: got %d models but %d positions", static_cast<int>(count), static_cast<int>(flat ? position_count / 3 : position_count));
+	}
+	// every position is checked before any model moves, so a bad element neither lands a model at the origin nor leaves
+	// the batch half applied
+	for (lua_Integer element = 1; element <= position_count; element++) {
+		lua_rawgeti(lua_state, 2, element);
+		if (flat ? !lua_isnumber(lua_state, -1) : !luabridge::Stack<glm::vec3>::isInstance(lua_state, -1)) {
+			return luaL_error(lua_state, "SetTranslations: position element %d is %s, not a %s", static_cast<int>(element), luaL_typename(lua_state, -1), flat ? "number" : "vec3");
+		}
+		lua_pop(lua_state, 1);
+	}
+	Renderer* renderer = luabridge::getGlobal(lua_state, "_Renderer").cast<Renderer*>();
+	for (lua_Integer i = 1; i <= count; i++) {
+		lua_rawgeti(lua_state, 1, i);
+		Model* model = luabridge::Stack<Model*>::get(lua_state, -1);
+		lua_pop(lua_state, 1);
+		if (model == nullptr) {
+			continue;
+		}
+		if (flat) {
+			lua_rawgeti(lua_state, 2, i * 3 - 2);
+			lua_rawgeti(lua_state, 2, i * 3 - 1);
+			lua_rawgeti(lua_state, 2, i * 3);
+			model->transform.translation = {
+				static_cast<float>(lua_tonumber(lua_state, -3)),
+				static_cast<float>(lua_tonumber(lua_state, -2)),
+				static_cast<float>(lua_tonumber(lua_state, -1)),
+			};
+			lua_pop(lua_state, 3);
+		} else {
+			lua_rawgeti(lua_state, 2, i);
+			model->transform.translation = *luabridge::Stack<const glm::vec3*>::get(lua_state, -1);
+			lua_pop(lua_state, 1);
+		}
+		model->write_transform(renderer);
+	}
+	return 0;
+}
+
 
 TemplateManager::TemplateManager(std::shared_ptr<Renderer> renderer, lua_State* lua_state) : lua_state(lua_state), renderer(renderer) {
 	templates.insert({ "", {} });
@@ -546,93 +1135,243 @@ Actor TemplateManager::create_actor(const rapidjson::Value& actor_json) {
 	std::sort(keys.begin(), keys.end());
 
 	for (auto& key : keys) {
-		luabridge::LuaRef new_component = luabridge::newTable(lua_state);
-		auto it = templ.keys.find(key);
-		std::string type;
-		if (it != templ.keys.end()) {
-			type = templ.components[it->second].type;
-			if (type == "Model") {
-				new_component = Model(templ.components[it->second].lua_component.cast<Model>());
-			} else {
-				set_metatable(new_component, templ.components[it->second].lua_component);
-			}
-		}
-		else {
-			type = components[key.c_str()]["type"].GetString();
-			if (type == "Model") {
-				new_component = Model(lua_state);
-			} else {
-				load_component(type);
-				set_metatable(new_component, this->components.find(type)->second);
-			}
-		}
-		if (components.HasMember(key.c_str())) {
-			const auto& component = components[key.c_str()];
-			for (auto it = component.MemberBegin(); it != component.MemberEnd(); it++) {
-				if (std::string_view{ it->name.GetString() } != "type") {
-					new_component[it->name.GetString()] = get_value(lua_state, it->value);
-				}
-			}
-		}
-		new_component["key"] = key;
-		actor.add_component({ new_component, std::move(key), std::move(type) });
+		const rapidjson::Value* overrides = components.HasMember(key.c_str()) ? &components[key.c_str()] : nullptr;
+		std::string type = overrides != nullptr ? get_value<const char*>(*overrides, "type").value_or("") : "";
+		actor.add_component(make_component(templ, template_name, std::move(key), std::move(type), json_fields(overrides)));
 	}
 	return actor;
 }
 
-Actor TemplateManager::create_template_actor(std::string template_name) {
+Actor TemplateManager::create_actor(const cooked::File& file, uint32_t index) {
+	const cooked::Actor& record = file.actor(index);
+	std::string template_name{ file.string(record.template_name) };
 	load_template(template_name);
 	const Actor& templ = templates.find(template_name)->second;
-	Actor actor;
-	actor.name = templ.name.c_str();
 
-	for (ComponentIndex i = 0; i < templ.components.size(); i++) {
-		const auto& component = templ.components[i];
-		std::string key = component.key;
-		std::string type = component.type;
-		if (type == "Model") {
-			actor.add_component({ { lua_state, Model(component.lua_component.cast<Model>()) }, std::move(key), std::move(type) });
-		} else {
-			luabridge::LuaRef new_component = luabridge::newTable(lua_state);
-			set_metatable(new_component, component.lua_component);
-			new_component["key"] = key;
-			actor.add_component({ new_component, std::move(key), std::move(type) });
-		}
+	Actor actor;
+	actor.name = file.string(record.name);
+	for (uint32_t i = 0; i < record.components.count; i++) {
+		const cooked::Component& component = file.component(record.components.offset + i);
+		actor.add_component(make_component(templ, template_name, std::string{ file.string(component.key) }, std::string{ file.string(component.type) }, cooked_fields(file, component.fields)));
 	}
 	return actor;
 }
 
-luabridge::LuaRef TemplateManager::create_component(std::string type, std::string key) {
-	if (type == "Model") {
-		Model new_component = { lua_state };
-		new_component.key = key;
-		return { lua_state, new_component };
-	} else {
-		luabridge::LuaRef new_component = luabridge::newTable(lua_state);
-		load_component(type);
-		set_metatable(new_component, components.find(type)->second);
-		new_component["key"] = key;
-		return new_component;
+static TemplateManager::Placement make_placement(const std::map<std::string, std::pair<glm::vec2, std::string>>& models) {
+	TemplateManager::Placement placement;
+	for (const auto& [key, model] : models) {
+		if (!placement.position.has_value()) {
+			placement.position = model.first;
+		}
+		if (!model.second.empty()) {
+			placement.meshes.push_back(model.second);
+		}
 	}
+	return placement;
 }
 
-AudioManager::AudioManager() {
-	if (Mix_OpenAudio(48000, AUDIO_S16SYS, 1, 2048)) {
-		std::cout << "Failed to open audio";
-		exit(0);
+// Model components of a template by key, with their ground position and mesh
+static std::map<std::string, std::pair<glm::vec2, std::string>> template_models(const Actor& templ) {
+	std::map<std::string, std::pair<glm::vec2, std::string>> models;
+	for (const auto& component : templ.components) {
+		if (component.type == "Model") {
+			const Model* model = component.lua_component.cast<Model*>();
+			models[component.key] = { { model->transform.translation.x, model->transform.translation.z }, model->mesh };
+		}
+	}
+	return models;
+}
+
+TemplateManager::Placement TemplateManager::placement(const rapidjson::Value& actor_json) {
+	std::string template_name = get_value<const char*>(actor_json, "template").value_or("");
+	load_template(template_name);
+	auto models = template_models(templates.find(template_name)->second);
+	if (actor_json.HasMember("components")) {
+		const auto& components = actor_json["components"];
+		for (auto it = components.MemberBegin(); it != components.MemberEnd(); it++) {
+			std::string key = it->name.GetString();
+			if (models.count(key) == 0 && get_string(it->value, "type") != "Model") {
+				continue;
+			}
+			auto& [position, mesh] = models[key];
+			position.x = get_number(it->value, "translation_x").value_or(position.x);
+			position.y = get_number(it->value, "translation_z").value_or(position.y);
+			mesh = get_string(it->value, "mesh").value_or(mesh);
+		}
+	}
+	return make_placement(models);
+}
+
+TemplateManager::Placement TemplateManager::placement(const cooked::File& file, uint32_t index) {
+	const cooked::Actor& record = file.actor(index);
+	std::string template_name{ file.string(record.template_name) };
+	load_template(template_name);
+	auto models = template_models(templates.find(template_name)->second);
+	for (uint32_t i = 0; i < record.components.count; i++) {
+		const cooked::Component& component = file.component(record.components.offset + i);
+		if (file.string(component.type) != "Model") {
+			continue;
+		}
+		auto& [position, mesh] = models[std::string{ file.string(component.key) }];
+		for (uint32_t j = 0; j < component.fields.count; j++) {
+			const cooked::Field& field = file.field(component.fields.offset + j);
+			const cooked::Value& value = file.value(field.value);
+			std::string_view name = file.string(field.name);
+			bool numeric = value.type == cooked::ValueType::Int || value.type == cooked::ValueType::Number;
+			float number = value.type == cooked::ValueType::Int ? static_cast<float>(value.integer) : static_cast<float>(value.number);
+			if (name == "translation_x" && numeric) {
+				position.x = number;
+			} else if (name == "translation_z" && numeric) {
+				position.y = number;
+			} else if (name == "mesh" && value.type == cooked::ValueType::String) {
+				mesh = file.string(value.index);
+			}
+		}
+	}
+	return make_placement(models);
+}
+
+// type is only used when the template has no component under key
+Component TemplateManager::make_component(const Actor& templ, const std::string& template_name, std::string key, std::string type, const ComponentFields& overrides) {
+	luabridge::LuaRef new_component(lua_state);
+	luabridge::LuaRef parent(lua_state);
+	std::string parent_name;
+	auto it = templ.keys.find(key);
+	if (it != templ.keys.end()) {
+		type = templ.components[it->second].type;
+		parent = templ.components[it->second].lua_component;
+		parent_name = template_name + '.' + key;
+	} else if (type != "Model") {
+		if (components.count(type) == 0) {
+			load_component(type);
+		}
+		parent = components.find(type)->second;
+		parent_name = type;
+	}
+	if (type == "Model") {
+		new_component = it != templ.keys.end() ? Model(parent.cast<Model>()) : Model(lua_state);
+		if (overrides.count != 0) {
+			overrides.for_each([&](const char* name) {
+				new_component[name] = luabridge::LuaRef::fromStack(lua_state);
+			});
+		}
+	} else {
+		if (overrides.count != 0) {
+			parent = make_prototype(parent_name + '\n' + overrides.id, parent, overrides);
+		}
+		new_component = make_instance(parent);
+	}
+	new_component["key"] = key;
+	return { new_component, std::move(key), std::move(type) };
+}
+
+Actor TemplateManager::create_template_actor(std::string template_name) {
+	load_template(template_name);
+	const Actor& templ = templates.find(template_name)->second;
+	Actor actor;
+	actor.name = templ.name.c_str();
+
+	for (ComponentIndex i = 0; i < templ.components.size(); i++) {
+		const auto& component = templ.components[i];
+		std::string key = component.key;
+		std::string type = component.type;
+		if (type == "Model") {
+			Model model = component.lua_component.cast<Model>();
+			model.key = key;
+			actor.add_component({ { lua_state, std::move(model) }, std::move(key), std::move(type) });
+		} else {
+			luabridge::LuaRef new_component = make_instance(component.lua_component);
+			new_component["key"] = key;
+			actor.add_component({ new_component, std::move(key), std::move(type) });
+		}
+	}
+	return actor;
+}
+
+luabridge::LuaRef TemplateManager::create_component(std::string type, std::string key) {
+	if (type == "Model") {
+		Model new_component = { lua_state };
+		new_component.key = key;
+		return { lua_state, new_component };
+	} else {
+		if (components.count(type) == 0) {
+			load_component(type);
+		}
+		luabridge::LuaRef new_component = make_instance(components.find(type)->second);
+		new_component["key"] = key;
+		return new_component;
+	}
+}
+
+void TemplateManager::preload_template(const std::string& name) {
+	load_template(name);
+}
+
+void TemplateManager::preload_component(const std::string& type) {
+	if (components.count(type) == 0) {
+		load_component(type);
+	}
+}
+
+void TemplateManager::clear_prototypes() {
+	prototypes.clear();
+}
+
+luabridge::LuaRef TemplateManager::make_prototype(const std::string& id, const luabridge::LuaRef& parent, const ComponentFields& overrides) {
+	auto found = prototypes.find(id);
+	if (found != prototypes.end()) {
+		return found->second;
+	}
+
+	parent.push();
+	lua_createtable(lua_state, 0, overrides.count + 2);
+	overrides.for_each([&](const char* name) {
+		lua_setfield(lua_state, -2, name);
+	});
+	set_component_index(lua_state, -1);
+	lua_pushcfunction(lua_state, &component_newindex);
+	lua_setfield(lua_state, -2, "__newindex");
+	lua_insert(lua_state, -2);
+	lua_setmetatable(lua_state, -2);
+	luabridge::LuaRef prototype = luabridge::LuaRef::fromStack(lua_state);
+	prototypes.insert({ id, prototype });
+	return prototype;
+}
+
+AudioManager::AudioManager() {
+	if (Mix_OpenAudio(48000, AUDIO_S16SYS, 1, 2048)) {
+		std::cout << "Failed to open audio";
+		exit(0);
 	}
 	Mix_AllocateChannels(50);
 }
 
+static Mix_Chunk* load_chunk(const std::string& path) {
+	std::optional<std::string> preloaded = StartupPreloader::take_file(path);
+	if (preloaded.has_value()) {
+		return Mix_LoadWAV_RW(SDL_RWFromConstMem(preloaded->data(), static_cast<int>(preloaded->size())), 1);
+	}
+	std::optional<ResourceData> contents = ResourceFS::read(path);
+	if (!contents.has_value()) {
+		return nullptr;
+	}
+	std::span<const char> bytes = contents->bytes();
+	return Mix_LoadWAV_RW(SDL_RWFromConstMem(bytes.data(), static_cast<int>(bytes.size())), 1);
+}
+
+bool AudioManager::is_loaded(const std::string& file_name) const {
+	return audio.count(file_name) != 0;
+}
+
 Mix_Chunk* AudioManager::load_sound(const std::string& file_name) {
 	if (audio.count(file_name) != 0) {
 		return audio[file_name];
 	}
 	std::string file_path_wav = translate_path("resources/audio/") + file_name + ".wav";
 	std::string file_path_ogg = translate_path("resources/audio/") + file_name + ".ogg";
-	Mix_Chunk* chunk = Mix_LoadWAV(file_path_wav.c_str());
+	Mix_Chunk* chunk = load_chunk(file_path_wav);
 	if (chunk == nullptr) {
-		chunk = Mix_LoadWAV(file_path_ogg.c_str());
+		chunk = load_chunk(file_path_ogg);
 	}
 	if (chunk == nullptr) {
 		std::cout << "error: failed to play audio clip " << file_name;
@@ -642,6 +1381,17 @@ Mix_Chunk* AudioManager::load_sound(const std::string& file_name) {
 	return chunk;
 }
 
+Mix_Chunk* AudioManager::load_sound(const std::string& file_name, std::span<const char> bytes) {
+	if (audio.count(file_name) != 0) {
+		return audio[file_name];
+	}
+	Mix_Chunk* chunk = Mix_LoadWAV_RW(SDL_RWFromConstMem(bytes.data(), static_cast<int>(bytes.size())), 1);
+	if (chunk != nullptr) {
+		audio[file_name] = chunk;
+	}
+	return chunk;
+}
+
 int AudioManager::play_sound(Mix_Chunk* audio, int channel, bool loops) const {
 	return Mix_PlayChannel(channel, audio, -static_cast<int>(loops));
 }
@@ -654,6 +1404,360 @@ void AudioManager::set_volume(int channel, int volume) const {
 	Mix_Volume(channel, volume);
 }
 
+// template names passed as string literals to Instantiate in a component's source, e.g. Actor.Instantiate("Rocket")
+static void find_instantiated(std::string_view source, const std::function<void(std::string)>& found) {
+	constexpr std::string_view call = "Instantiate";
+	for (size_t at = source.find(call); at != std::string_view::npos; at = source.find(call, at)) {
+		at += call.size();
+		size_t i = source.find_first_not_of(" \t\r\n", at);
+		if (i != std::string_view::npos && source[i] == '(') {
+			i = source.find_first_not_of(" \t\r\n", i + 1);
+		}
+		if (i == std::string_view::npos || (source[i] != '"' && source[i] != '\'')) {
+			continue;
+		}
+		size_t end = source.find_first_of(std::string{ source[i] } + "\\\n", i + 1);
+		if (end != std::string_view::npos && source[end] == source[i]) {
+			found(std::string{ source.substr(i + 1, end - i - 1) });
+		}
+	}
+}
+
+SceneManifest SceneManifest::scan(const std::string& scene_name) {
+	const std::string path = translate_path("resources/scenes/") + scene_name + ".scene";
+	cooked::File cooked_scene;
+	if (prefer_cooked(path) && cooked_scene.open(path + "c") && cooked_scene.header().kind == cooked::Kind::Scene && cooked_dependencies_current(cooked_scene)) {
+		return scan(&cooked_scene, nullptr);
+	}
+	// a missing scene is left for the main thread to report
+	if (!file_exists(path)) {
+		return {};
+	}
+	JsonFile file(path);
+	return scan(nullptr, &file.doc());
+}
+
+// string fields that name a file in resources/audio/ are taken to be clips
+SceneManifest SceneManifest::scan(const cooked::File* cooked_scene, const rapidjson::Value* json_scene) {
+	std::vector<std::string> template_names, types;
+	std::unordered_set<std::string> seen_templates, seen_types, meshes, strings;
+	auto add_template = [&](std::string name) {
+		if (seen_templates.insert(name).second) {
+			template_names.push_back(std::move(name));
+		}
+	};
+	auto add_type = [&](std::string type) {
+		if (type != "Model" && type != "Rigidbody" && seen_types.insert(type).second) {
+			types.push_back(std::move(type));
+		}
+	};
+	auto add_preload = [&](std::string_view list, std::string name) {
+		if (list == "templates") {
+			add_template(std::move(name));
+		} else if (list == "components") {
+			add_type(std::move(name));
+		} else if (list == "meshes") {
+			meshes.insert(std::move(name));
+		} else if (list == "audio") {
+			strings.insert(std::move(name));
+		}
+	};
+	auto visit_json = [&](const rapidjson::Value& actor) {
+		if (std::optional<std::string> template_name = get_string(actor, "template")) {
+			add_template(*template_name);
+		}
+		if (!actor.HasMember("components")) {
+			return;
+		}
+		const auto& components = actor["components"];
+		for (auto component = components.MemberBegin(); component != components.MemberEnd(); component++) {
+			for (auto field = component->value.MemberBegin(); field != component->value.MemberEnd(); field++) {
+				if (!field->value.IsString()) {
+					continue;
+				}
+				std::string_view name = field->name.GetString();
+				if (name == "type") {
+					add_type(field->value.GetString());
+				} else {
+					(name == "mesh" ? meshes : strings).insert(field->value.GetString());
+				}
+			}
+		}
+	};
+	auto visit_cooked = [&](const cooked::File& file, const cooked::Actor& record) {
+		if (record.template_name != cooked::none) {
+			add_template(std::string{ file.string(record.template_name) });
+		}
+		for (uint32_t i = 0; i < record.components.count; i++) {
+			const cooked::Component& component = file.component(record.components.offset + i);
+			add_type(std::string{ file.string(component.type) });
+			for (uint32_t j = 0; j < component.fields.count; j++) {
+				const cooked::Field& field = file.field(component.fields.offset + j);
+				const cooked::Value& value = file.value(field.value);
+				if (value.type == cooked::ValueType::String) {
+					(file.string(field.name) == "mesh" ? meshes : strings).insert(std::string{ file.string(value.index) });
+				}
+			}
+		}
+	};
+	// missing or broken templates are left for the main thread to report
+	auto visit_template = [&](const std::string& path) {
+		cooked::File cooked_file;
+		if (prefer_cooked(path) && cooked_file.open(path + "c") && cooked_file.header().kind == cooked::Kind::Template) {
+			for (uint32_t i = 0; i < cooked_file.actor_count(); i++) {
+				visit_cooked(cooked_file, cooked_file.actor(i));
+			}
+			return true;
+		}
+		if (file_exists(path)) {
+			JsonFile file(path);
+			visit_json(file.doc());
+			return true;
+		}
+		return false;
+	};
+
+	if (cooked_scene != nullptr) {
+		const cooked::Header& header = cooked_scene->header();
+		if (header.preload != cooked::none) {
+			const cooked::Value& lists = cooked_scene->value(header.preload);
+			for (uint32_t i = 0; i < lists.count; i++) {
+				const cooked::Field& list = cooked_scene->field(lists.index + i);
+				const cooked::Value& names = cooked_scene->value(list.value);
+				for (uint32_t j = 0; names.type == cooked::ValueType::Array && j < names.count; j++) {
+					const cooked::Value& name = cooked_scene->value(names.index + j);
+					if (name.type == cooked::ValueType::String) {
+						add_preload(cooked_scene->string(list.name), std::string{ cooked_scene->string(name.index) });
+					}
+				}
+			}
+		}
+		for (uint32_t i = 0; i < cooked_scene->actor_count(); i++) {
+			visit_cooked(*cooked_scene, cooked_scene->actor(i));
+		}
+	} else if (json_scene != nullptr) {
+		if (json_scene->HasMember("preload") && (*json_scene)["preload"].IsObject()) {
+			const auto& lists = (*json_scene)["preload"];
+			for (auto list = lists.MemberBegin(); list != lists.MemberEnd(); list++) {
+				if (!list->value.IsArray()) {
+					continue;
+				}
+				for (const auto& name : list->value.GetArray()) {
+					if (name.IsString()) {
+						add_preload(list->name.GetString(), name.GetString());
+					}
+				}
+			}
+		}
+		if (json_scene->HasMember("actors") && (*json_scene)["actors"].IsArray()) {
+			for (const auto& actor : (*json_scene)["actors"].GetArray()) {
+				visit_json(actor);
+			}
+		}
+	}
+
+	// templates bring component types, whose scripts may instantiate further templates
+	SceneManifest manifest;
+	size_t next_template = 0;
+	size_t next_type = 0;
+	while (next_template < template_names.size() || next_type < types.size()) {
+		if (next_template < template_names.size()) {
+			const std::string& name = template_names[next_template++];
+			if (visit_template(translate_path("resources/actor_templates/") + name + ".template")) {
+				manifest.templates.push_back(name);
+			}
+			continue;
+		}
+		const std::string& type = types[next_type++];
+		const std::string source_path = translate_path("resources/component_types/") + type + ".lua";
+		if (file_exists(source_path)) {
+			find_instantiated(read_file_bytes(source_path, false), add_template);
+			manifest.components.push_back(type);
+		} else if (file_exists(translate_path("resources/component_types/") + type + ".luac")) {
+			manifest.components.push_back(type);
+		}
+	}
+	for (const auto& mesh : meshes) {
+		std::string path = translate_path("resources/meshes/") + mesh;
+		if (file_exists(path)) {
+			manifest.meshes.push_back(std::move(path));
+		}
+	}
+	for (const auto& clip : strings) {
+		for (const char* extension : { ".wav", ".ogg" }) {
+			std::string path = translate_path("resources/audio/") + clip + extension;
+			if (file_exists(path)) {
+				manifest.audio.push_back({ clip, std::move(path) });
+				break;
+			}
+		}
+	}
+	return manifest;
+}
+
+StartupPreloader* StartupPreloader::current = nullptr;
+
+StartupPreloader::StartupPreloader(std::string scene_name) : scene_name(std::move(scene_name)) {
+#ifndef __EMSCRIPTEN__
+	// the main thread is busy creating the device, so leave it a core
+	unsigned int thread_count = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+	current = this;
+	for (unsigned int i = 0; i < thread_count; i++) {
+		workers.emplace_back(&StartupPreloader::work, this, i == 0);
+	}
+#endif
+}
+
+StartupPreloader::~StartupPreloader() {
+	for (auto& worker : workers) {
+		if (worker.joinable()) {
+			worker.join();
+		}
+	}
+	if (current == this) {
+		current = nullptr;
+	}
+}
+
+void StartupPreloader::work(bool scanner) {
+	if (scanner) {
+		scan();
+	} else {
+		std::unique_lock<std::mutex> lock(mutex);
+		progress.wait(lock, [&] { return scanned; });
+	}
+	for (size_t i = next_job++; i < jobs.size(); i = next_job++) {
+		run_job(jobs[i]);
+	}
+}
+
+void StartupPreloader::scan() {
+	SceneManifest manifest = SceneManifest::scan(scene_name);
+	std::vector<Job> found;
+	std::unordered_set<std::string> waiting;
+	for (const auto& type : manifest.components) {
+		found.push_back({ Job::Kind::Component, type });
+		waiting.insert(translate_path("resources/component_types/") + type + ".lua");
+		waiting.insert(translate_path("resources/component_types/") + type + ".luac");
+	}
+	for (const auto& path : manifest.meshes) {
+		found.push_back({ Job::Kind::Mesh, path });
+	}
+	for (const auto& clip : manifest.audio) {
+		found.push_back({ Job::Kind::File, clip.path });
+		waiting.insert(clip.path);
+	}
+	std::stringstream event;
+	event << "scanned " << scene_name << ": " << manifest.templates.size() << " templates, " << manifest.components.size() << " component types, "
+		<< manifest.meshes.size() << " meshes, " << manifest.audio.size() << " audio clips";
+	mark(event.str());
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs = std::move(found);
+		pending = std::move(waiting);
+		scanned = true;
+	}
+	progress.notify_all();
+}
+
+void StartupPreloader::run_job(const Job& job) {
+	std::vector<std::pair<std::string, std::string>> read;
+	std::optional<tinygltf::Model> model;
+	std::vector<std::string> done = { job.path };
+	if (job.kind == Job::Kind::File) {
+		read.push_back({ job.path, read_file_bytes(job.path, false) });
+	} else if (job.kind == Job::Kind::Component) {
+		// the same files load_component_chunk reads: the source and its cached bytecode, or the shipped .luac
+		const std::string source_path = translate_path("resources/component_types/") + job.path + ".lua";
+		const std::string bytecode_path = translate_path("resources/component_types/") + job.path + ".luac";
+		done = { source_path, bytecode_path };
+		std::error_code error;
+		if (file_exists(source_path)) {
+			std::string source = read_file_bytes(source_path, false);
+			const std::filesystem::path cache_path = bytecode_cache_path(job.path, source);
+			if (std::filesystem::exists(cache_path, error)) {
+				read.push_back({ cache_path.string(), read_file_bytes(cache_path.string(), false) });
+			}
+			read.push_back({ source_path, std::move(source) });
+		} else if (file_exists(bytecode_path)) {
+			read.push_back({ bytecode_path, read_file_bytes(bytecode_path, false) });
+		}
+	} else {
+		// a model that fails to parse is left for loadModel to report on the main thread
+		std::string error;
+		model = Renderer::decodeModel(job.path, error);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto& [path, bytes] : read) {
+		files.insert({ std::move(path), std::move(bytes) });
+	}
+	if (model.has_value()) {
+		models.insert({ job.path, std::move(*model) });
+	}
+	for (const auto& path : done) {
+		pending.erase(path);
+	}
+	progress.notify_all();
+}
+
+std::optional<std::string> StartupPreloader::take_file(const std::string& path) {
+	if (current == nullptr) {
+		return {};
+	}
+	StartupPreloader& preloader = *current;
+	std::unique_lock<std::mutex> lock(preloader.mutex);
+	preloader.progress.wait(lock, [&] { return preloader.scanned && preloader.pending.count(path) == 0; });
+	auto it = preloader.files.find(path);
+	if (it == preloader.files.end()) {
+		return {};
+	}
+	std::string bytes = std::move(it->second);
+	preloader.files.erase(it);
+	return bytes;
+}
+
+void StartupPreloader::mark(std::string event) {
+	if (current == nullptr) {
+		return;
+	}
+	StartupPreloader& preloader = *current;
+	std::chrono::duration<double, std::milli> elapsed = Clock::now() - preloader.start;
+	std::lock_guard<std::mutex> lock(preloader.mutex);
+	preloader.timeline.push_back({ elapsed.count(), std::move(event) });
+}
+
+void StartupPreloader::join(Renderer& renderer) {
+	if (current == nullptr) {
+		return;
+	}
+	StartupPreloader& preloader = *current;
+	for (auto& worker : preloader.workers) {
+		worker.join();
+	}
+	preloader.workers.clear();
+	mark("workers done");
+	for (auto& [path, model] : preloader.models) {
+		renderer.addDecodedModel(path, std::move(model));
+	}
+	preloader.models.clear();
+	mark("meshes handed to renderer");
+	// the initial scene is up, so whatever it did not read is not worth holding on to; later reads go to the disk
+	size_t untaken = 0;
+	{
+		std::lock_guard<std::mutex> lock(preloader.mutex);
+		untaken = preloader.files.size();
+		preloader.files.clear();
+	}
+	if (untaken != 0) {
+		mark("freed " + std::to_string(untaken) + " untaken files");
+	}
+	std::cout << "Startup timeline:" << std::endl;
+	for (const auto& [ms, event] : preloader.timeline) {
+		std::cout << "  " << static_cast<int>(ms) << " ms: " << event << std::endl;
+	}
+}
+
 luabridge::LuaRef AddComponentQueue::push(std::string type, ActorIndex index, ActorId id) {
 	std::stringstream key;
 	key << 'r' << global_count;
@@ -707,18 +1811,69 @@ luabridge::LuaRef World::LuaActor::add_component(const char* type, lua_State* lu
 }
 
 void World::LuaActor::remove_component(luabridge::LuaRef component_ref) {
-	actor.remove_component(component_ref["key"]);
+	std::string key = component_ref["key"];
+	actors.unindex_component(index, actor.keys.at(key));
+	actor.remove_component(key);
+	if (!actor.active && !actor.to_destroy.empty()) {
+		actors.inactive_destroy.push_back({ index, actor.id });
+	}
+}
+
+void World::LuaActor::set_enabled(luabridge::LuaRef component_ref, bool enabled) {
+	set_enabled_by_key(component_ref["key"], enabled);
 }
 
-void World::LuaActor::call_component_method(luabridge::LuaRef component, std::string_view name) {
-	if (component.isNil()) {
+void World::LuaActor::set_enabled_by_key(const std::string& key, bool enabled) {
+	auto it = actor.keys.find(key);
+	if (it == actor.keys.end()) {
 		return;
 	}
-	const luabridge::LuaRef& ref = component[name.data()];
-	if (ref.isNil() || !component["enabled"].cast<bool>()) {
+	Component& component = actor.components[it->second];
+	if (component.type == "Model") {
+		component.lua_component.cast<Model*>()->enabled = enabled;
+	}
+	actor.set_enabled(it->second, enabled);
+}
+
+bool World::LuaActor::is_enabled(luabridge::LuaRef component_ref) const {
+	auto it = actor.keys.find(component_ref["key"]);
+	return it != actor.keys.end() && actor.components[it->second].enabled;
+}
+
+void World::LuaActor::set_active(bool active) {
+	actors.set_active(index, active);
+}
+
+bool World::LuaActor::is_active() const {
+	return actor.active;
+}
+
+void World::LuaActor::call_component_method(const Component& component, std::string_view name) {
+	if (!component.enabled || component.lua_component.isNil()) {
+		return;
+	}
+	luabridge::LuaRef ref = component.lua_component[name.data()];
+	if (ref.isNil()) {
+		return;
+	}
+	ScriptWatchdog* watchdog = ScriptWatchdog::from(ref.state());
+	if (watchdog == nullptr) {
+		sandbox_call(ref, actor.name, component.lua_component);
 		return;
 	}
-	sandbox_call(ref, actor.name, component);
+	// the call may destroy this actor, so everything needed afterwards is copied out first
+	ActorCollection& collection = actors;
+	ActorIndex owner_index = index;
+	ActorId owner_id = actor.id;
+	std::string key = component.key;
+	watchdog->begin_call(actor.name, component.type, name);
+	sandbox_call(ref, actor.name, component.lua_component);
+	if (watchdog->end_call()) {
+		LuaActor* owner = collection.actors[owner_index].actor.get();
+		if (owner != nullptr && owner->actor.id == owner_id) {
+			owner->set_enabled_by_key(key, false);
+		}
+	}
 }
 
 
@@ -825,21 +1980,771 @@ void EventBus::apply_scheduled() {
 	unsubscribe_queue.clear();
 }
 
+std::vector<std::pair<std::string, EventBus::Handler>> EventBus::subscriptions() const {
+	std::vector<std::pair<std::string, Handler>> handlers;
+	for (const auto& [event_type, set] : subs) {
+		for (const auto& handler : set) {
+			handlers.push_back({ event_type, handler });
+		}
+	}
+	handlers.insert(handlers.end(), subscribe_queue.begin(), subscribe_queue.end());
+	for (const auto& pending : unsubscribe_queue) {
+		auto it = std::find(handlers.begin(), handlers.end(), pending);
+		if (it != handlers.end()) {
+			handlers.erase(it);
+		}
+	}
+	return handlers;
+}
+
+
+static void append_varint(std::string& out, uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back(static_cast<char>(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back(static_cast<char>(value));
+}
+
+void SnapshotWriter::byte(uint8_t value) {
+	data.push_back(static_cast<char>(value));
+}
+
+void SnapshotWriter::varint(uint64_t value) {
+	append_varint(data, value);
+}
+
+void SnapshotWriter::floats(const float* values, size_t count) {
+	data.append(reinterpret_cast<const char*>(values), count * sizeof(float));
+}
+
+void SnapshotWriter::string(std::string_view value) {
+	auto [it, inserted] = interned.try_emplace(std::string(value), string_count);
+	if (inserted) {
+		string_count += 1;
+		append_varint(strings, value.size());
+		strings.append(value);
+	}
+	varint(it->second);
+}
+
+void SnapshotWriter::transform(const Transform& value) {
+	floats(&value.translation.x, 3);
+	floats(&value.rotation.x, 3);
+	floats(&value.scale.x, 3);
+}
+
+void SnapshotWriter::metatable(lua_State* lua_state, int index) {
+	if (!lua_getmetatable(lua_state, index)) {
+		varint(0);
+		return;
+	}
+	auto [it, inserted] = metatable_indices.try_emplace(lua_topointer(lua_state, -1), static_cast<uint32_t>(metatables.size()));
+	if (inserted) {
+		metatables.push_back(luabridge::LuaRef::fromStack(lua_state));
+	} else {
+		lua_pop(lua_state, 1);
+	}
+	varint(it->second + 1);
+}
+
+bool SnapshotWriter::storable(lua_State* lua_state, int index) const {
+	switch (lua_type(lua_state, index)) {
+	case LUA_TNIL:
+	case LUA_TBOOLEAN:
+	case LUA_TNUMBER:
+	case LUA_TSTRING:
+	case LUA_TTABLE:
+		return true;
+	case LUA_TUSERDATA:
+		return luabridge::Stack<glm::vec2>::isInstance(lua_state, index) || luabridge::Stack<glm::vec3>::isInstance(lua_state, index)
+			|| luabridge::Stack<Transform>::isInstance(lua_state, index) || (find_reference && find_reference(lua_state, index).has_value());
+	default:
+		return false;
+	}
+}
+
+bool SnapshotWriter::lua_value(lua_State* lua_state, int index) {
+	index = lua_absindex(lua_state, index);
+	int type = lua_type(lua_state, index);
+	if ((type == LUA_TTABLE || type == LUA_TUSERDATA) && find_reference) {
+		if (std::optional<SnapshotRef> reference = find_reference(lua_state, index)) {
+			byte(static_cast<uint8_t>(reference->key.empty() ? SnapshotTag::Actor : SnapshotTag::Component));
+			varint(reference->record);
+			if (!reference->key.empty()) {
+				string(reference->key);
+			}
+			return true;
+		}
+	}
+	switch (type) {
+	case LUA_TNIL:
+		byte(static_cast<uint8_t>(SnapshotTag::Nil));
+		return true;
+	case LUA_TBOOLEAN:
+		byte(static_cast<uint8_t>(lua_toboolean(lua_state, index) ? SnapshotTag::True : SnapshotTag::False));
+		return true;
+	case LUA_TNUMBER:
+		if (lua_isinteger(lua_state, index)) {
+			// zigzag, so small negative numbers stay short
+			uint64_t value = static_cast<uint64_t>(lua_tointeger(lua_state, index));
+			byte(static_cast<uint8_t>(SnapshotTag::Integer));
+			varint((value << 1) ^ (0 - (value >> 63)));
+		} else {
+			double value = lua_tonumber(lua_state, index);
+			byte(static_cast<uint8_t>(SnapshotTag::Number));
+			data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+		}
+		return true;
+	case LUA_TSTRING: {
+		size_t length = 0;
+		const char* value = lua_tolstring(lua_state, index, &length);
+		byte(static_cast<uint8_t>(SnapshotTag::String));
+		string({ value, length });
+		return true;
+	}
+	case LUA_TTABLE: {
+		auto [it, inserted] = tables.try_emplace(lua_topointer(lua_state, index), static_cast<uint32_t>(tables.size()));
+		if (!inserted) {
+			byte(static_cast<uint8_t>(SnapshotTag::TableRef));
+			varint(it->second);
+			return true;
+		}
+		byte(static_cast<uint8_t>(SnapshotTag::Table));
+		metatable(lua_state, index);
+		lua_fields(lua_state, index, "");
+		byte(static_cast<uint8_t>(SnapshotTag::End));
+		return true;
+	}
+	case LUA_TUSERDATA:
+		if (luabridge::Stack<glm::vec2>::isInstance(lua_state, index)) {
+			byte(static_cast<uint8_t>(SnapshotTag::Vec2));
+			floats(&luabridge::Stack<const glm::vec2*>::get(lua_state, index)->x, 2);
+			return true;
+		}
+		if (luabridge::Stack<glm::vec3>::isInstance(lua_state, index)) {
+			byte(static_cast<uint8_t>(SnapshotTag::Vec3));
+			floats(&luabridge::Stack<const glm::vec3*>::get(lua_state, index)->x, 3);
+			return true;
+		}
+		if (luabridge::Stack<Transform>::isInstance(lua_state, index)) {
+			byte(static_cast<uint8_t>(SnapshotTag::Transform));
+			transform(*luabridge::Stack<const Transform*>::get(lua_state, index));
+			return true;
+		}
+		return false;
+	default:
+		return false;
+	}
+}
+
+void SnapshotWriter::lua_fields(lua_State* lua_state, int index, std::string_view name, const std::function<bool(std::string_view)>& skip) {
+	index = lua_absindex(lua_state, index);
+	size_t parent = path.size();
+	path += name;
+	lua_pushnil(lua_state);
+	while (lua_next(lua_state, index) != 0) {
+		bool skipped = skip && lua_type(lua_state, -2) == LUA_TSTRING && skip(lua_tostring(lua_state, -2));
+		if (skipped) {
+			lua_pop(lua_state, 1);
+			continue;
+		}
+		size_t field = path.size();
+		if (lua_type(lua_state, -2) == LUA_TSTRING) {
+			path += ".";
+			path += lua_tostring(lua_state, -2);
+		} else if (lua_isinteger(lua_state, -2)) {
+			path += "[" + std::to_string(lua_tointeger(lua_state, -2)) + "]";
+		} else {
+			path += "[";
+			path += luaL_typename(lua_state, -2);
+			path += "]";
+		}
+		if (!storable(lua_state, -2)) {
+			error = path.substr(0, field) + " has a key that is a " + luaL_typename(lua_state, -2);
+		} else if (!storable(lua_state, -1)) {
+			error = path + " holds a " + luaL_typename(lua_state, -1);
+		} else {
+			lua_value(lua_state, -2);
+			lua_value(lua_state, -1);
+		}
+		path.resize(field);
+		if (!error.empty()) {
+			lua_pop(lua_state, 2);
+			break;
+		}
+		lua_pop(lua_state, 1);
+	}
+	path.resize(parent);
+}
+
+std::string SnapshotWriter::finish() const {
+	std::string out;
+	append_varint(out, string_count);
+	out.reserve(out.size() + strings.size() + data.size());
+	out += strings;
+	out += data;
+	return out;
+}
+
+SnapshotReader::SnapshotReader(std::string_view blob, const std::vector<luabridge::LuaRef>& metatables) : data(blob), metatables(metatables) {
+	uint64_t count = varint();
+	strings.reserve(count);
+	for (uint64_t i = 0; i < count; i++) {
+		uint64_t length = varint();
+		strings.push_back(data.substr(position, length));
+		position += length;
+	}
+}
+
+uint8_t SnapshotReader::byte() {
+	return static_cast<uint8_t>(data[position++]);
+}
+
+uint64_t SnapshotReader::varint() {
+	uint64_t value = 0;
+	for (int shift = 0;; shift += 7) {
+		uint8_t next = byte();
+		value |= static_cast<uint64_t>(next & 0x7F) << shift;
+		if ((next & 0x80) == 0) {
+			return value;
+		}
+	}
+}
+
+void SnapshotReader::floats(float* values, size_t count) {
+	std::memcpy(values, data.data() + position, count * sizeof(float));
+	position += count * sizeof(float);
+}
+
+std::string_view SnapshotReader::string() {
+	return strings[varint()];
+}
+
+Transform SnapshotReader::transform() {
+	Transform value;
+	floats(&value.translation.x, 3);
+	floats(&value.rotation.x, 3);
+	floats(&value.scale.x, 3);
+	return value;
+}
+
+void SnapshotReader::lua_value(lua_State* lua_state) {
+	switch (static_cast<SnapshotTag>(byte())) {
+	case SnapshotTag::False:
+		lua_pushboolean(lua_state, false);
+		break;
+	case SnapshotTag::True:
+		lua_pushboolean(lua_state, true);
+		break;
+	case SnapshotTag::Integer: {
+		uint64_t value = varint();
+		lua_pushinteger(lua_state, static_cast<lua_Integer>((value >> 1) ^ (0 - (value & 1))));
+		break;
+	}
+	case SnapshotTag::Number: {
+		double value;
+		std::memcpy(&value, data.data() + position, sizeof(value));
+		position += sizeof(value);
+		lua_pushnumber(lua_state, value);
+		break;
+	}
+	case SnapshotTag::String: {
+		std::string_view value = string();
+		lua_pushlstring(lua_state, value.data(), value.size());
+		break;
+	}
+	case SnapshotTag::Table: {
+		lua_newtable(lua_state);
+		uint64_t metatable = varint();
+		if (metatable != 0) {
+			metatables[metatable - 1].push();
+			lua_setmetatable(lua_state, -2);
+		}
+		lua_pushvalue(lua_state, -1);
+		tables.push_back(luabridge::LuaRef::fromStack(lua_state));
+		lua_fields(lua_state, -1);
+		break;
+	}
+	case SnapshotTag::TableRef:
+		tables[varint()].push();
+		break;
+	case SnapshotTag::Vec2: {
+		glm::vec2 value;
+		floats(&value.x, 2);
+		luabridge::Stack<glm::vec2>::push(lua_state, value);
+		break;
+	}
+	case SnapshotTag::Vec3: {
+		glm::vec3 value;
+		floats(&value.x, 3);
+		luabridge::Stack<glm::vec3>::push(lua_state, value);
+		break;
+	}
+	case SnapshotTag::Transform:
+		luabridge::Stack<Transform>::push(lua_state, transform());
+		break;
+	case SnapshotTag::Actor:
+		push_reference(lua_state, { static_cast<uint32_t>(varint()), "" });
+		break;
+	case SnapshotTag::Component: {
+		uint32_t record = static_cast<uint32_t>(varint());
+		push_reference(lua_state, { record, std::string{ string() } });
+		break;
+	}
+	default:
+		lua_pushnil(lua_state);
+		break;
+	}
+}
+
+void SnapshotReader::lua_fields(lua_State* lua_state, int index) {
+	index = lua_absindex(lua_state, index);
+	while (static_cast<SnapshotTag>(data[position]) != SnapshotTag::End) {
+		lua_value(lua_state);
+		lua_value(lua_state);
+		// a key that resolved to nothing (a reference whose component was removed) is dropped with its value
+		if (lua_isnil(lua_state, -2)) {
+			lua_pop(lua_state, 2);
+		} else {
+			lua_rawset(lua_state, index);
+		}
+	}
+	position += 1;
+}
+
+
+// LuaRef::push ignores its argument and pushes onto the state the ref was created on
+static void push_ref(const luabridge::LuaRef& ref, lua_State* target) {
+	ref.push();
+	if (ref.state() != target) {
+		lua_xmove(ref.state(), target, 1);
+	}
+}
+
+// a ref to the same value made on the main thread, which outlives every coroutine
+static luabridge::LuaRef main_thread_ref(const luabridge::LuaRef& ref, lua_State* main_thread) {
+	push_ref(ref, main_thread);
+	return luabridge::LuaRef::fromStack(main_thread);
+}
+
+CoroutineScheduler::Id CoroutineScheduler::start(lua_State* from, Coroutine coroutine, luabridge::LuaRef function, std::string_view actor_name) {
+	// from (and the state function and component were made on) may be another coroutine, which can finish and be collected
+	// before this one; refs keep the state they were made on, so make them all on the main thread
+	lua_rawgeti(from, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+	lua_State* main_thread = lua_tothread(from, -1);
+	lua_pop(from, 1);
+	function = main_thread_ref(function, main_thread);
+	coroutine.component = main_thread_ref(coroutine.component, main_thread);
+	lua_State* thread = lua_newthread(main_thread);
+	coroutine.thread = luabridge::LuaRef::fromStack(main_thread);
+	push_ref(function, thread);
+	push_ref(coroutine.component, thread);
+	Id id = next_id++;
+	coroutines.insert({ id, std::move(coroutine) });
+	resume(from, id, actor_name, 1);
+	return id;
+}
+
+void CoroutineScheduler::stop(Id id) {
+	auto it = coroutines.find(id);
+	if (it != coroutines.end()) {
+		forget(it);
+	}
+}
+
+void CoroutineScheduler::forget(std::unordered_map<Id, Coroutine>::iterator it) {
+	const Coroutine& coroutine = it->second;
+	if (coroutine.waiting == WaitCondition::Kind::Event) {
+		auto waiters = event_waiters.find(coroutine.event);
+		if (waiters != event_waiters.end()) {
+			std::erase(waiters->second, it->first);
+			if (waiters->second.empty()) {
+				event_waiters.erase(waiters);
+			}
+		}
+	} else if (coroutine.waiting.has_value()) {
+		stale_wakes++;
+	}
+	coroutines.erase(it);
+	// stale wakes are skipped when they come due, but one far in the future would sit in its queue until then
+	if (stale_wakes > 64 && stale_wakes * 2 > frame_queue.size() + time_queue.size()) {
+		compact_queues();
+	}
+}
+
+void CoroutineScheduler::compact_queues() {
+	for (WakeQueue* queue : { &frame_queue, &time_queue }) {
+		WakeQueue live;
+		for (; !queue->empty(); queue->pop()) {
+			if (coroutines.count(queue->top().id) != 0) {
+				live.push(queue->top());
+			}
+		}
+		*queue = std::move(live);
+	}
+	stale_wakes = 0;
+}
+
+void CoroutineScheduler::notify_event(const std::string& event_type) {
+	auto it = event_waiters.find(event_type);
+	if (it == event_waiters.end()) {
+		return;
+	}
+	for (Id id : it->second) {
+		coroutines.at(id).waiting.reset();
+	}
+	ready.insert(ready.end(), it->second.begin(), it->second.end());
+	event_waiters.erase(it);
+}
+
+void CoroutineScheduler::resume(lua_State* from, Id id, std::string_view actor_name, int nargs) {
+	auto it = coroutines.find(id);
+	if (it == coroutines.end()) {
+		return;
+	}
+	// keep the thread anchored on the caller's stack while it runs, it may stop itself
+	push_ref(it->second.thread, from);
+	lua_State* thread = lua_tothread(from, -1);
+
+	int results = 0;
+	int status = lua_resume(thread, from, nargs, &results);
+	if (status != LUA_YIELD) {
+		if (status != LUA_OK) {
+			luaL_traceback(thread, thread, lua_tostring(thread, -1), 0);
+			std::string error = lua_tostring(thread, -1);
+			std::replace(error.begin(), error.end(), '\\', '/');
+			std::cout << "\033[31m" << actor_name << " : " << error << "\033[0m" << std::endl;
+		}
+		coroutines.erase(id);
+		lua_pop(from, 1);
+		return;
+	}
+
+	WaitCondition condition;
+	if (results > 0 && luabridge::Stack<WaitCondition>::isInstance(thread, -1)) {
+		condition = *luabridge::Stack<WaitCondition*>::get(thread, -1);
+	}
+	lua_pop(thread, results);
+	lua_pop(from, 1);
+	it = coroutines.find(id);
+	if (it == coroutines.end()) {
+		return;
+	}
+	it->second.waiting = condition.kind;
+	switch (condition.kind) {
+	case WaitCondition::Kind::Frames:
+		frame_queue.push({ static_cast<double>(frame + std::max<uint64_t>(condition.frames, 1)), id });
+		break;
+	case WaitCondition::Kind::Seconds:
+		time_queue.push({ time + condition.seconds, id });
+		break;
+	case WaitCondition::Kind::Event:
+		event_waiters[condition.event].push_back(id);
+		it->second.event = std::move(condition.event);
+		break;
+	}
+}
+
+void CoroutineScheduler::advance(uint64_t new_frame, double new_time) {
+	frame = new_frame;
+	time = new_time;
+}
+
+template<class NameOf>
+void CoroutineScheduler::resume_due(lua_State* from, NameOf name_of) {
+	std::vector<Id> due;
+	due.swap(ready);
+	for (WakeQueue* queue : { &frame_queue, &time_queue }) {
+		const double now = queue == &frame_queue ? static_cast<double>(frame) : time;
+		for (; !queue->empty() && queue->top().at <= now; queue->pop()) {
+			auto it = coroutines.find(queue->top().id);
+			if (it == coroutines.end()) {
+				stale_wakes -= std::min<size_t>(stale_wakes, 1);
+				continue;
+			}
+			it->second.waiting.reset();
+			due.push_back(it->first);
+		}
+	}
+	for (Id id : due) {
+		auto it = coroutines.find(id);
+		if (it == coroutines.end()) {
+			continue;
+		}
+		const std::string* actor_name = name_of(it->second);
+		if (actor_name == nullptr) {
+			forget(it);
+			continue;
+		}
+		resume(from, id, *actor_name, 0);
+	}
+}
+
+template<class NameOf>
+void CoroutineScheduler::purge(NameOf name_of) {
+	for (auto it = coroutines.begin(); it != coroutines.end();) {
+		auto next = std::next(it);
+		if (name_of(it->second) == nullptr) {
+			forget(it);
+		}
+		it = next;
+	}
+}
+
+
+void ScriptWatchdog::install(lua_State* lua_state, const WatchdogConfig& watchdog_config) {
+	config = watchdog_config;
+	*static_cast<ScriptWatchdog**>(lua_getextraspace(lua_state)) = config.enabled ? this : nullptr;
+	if (config.enabled) {
+		// threads created later (coroutines) inherit both the hook and the extra space
+		lua_sethook(lua_state, &ScriptWatchdog::hook, LUA_MASKCOUNT, config.check_interval);
+	}
+}
+
+ScriptWatchdog* ScriptWatchdog::from(lua_State* lua_state) {
+	return *static_cast<ScriptWatchdog**>(lua_getextraspace(lua_state));
+}
+
+void ScriptWatchdog::hook(lua_State* lua_state, lua_Debug*) {
+	ScriptWatchdog* watchdog = from(lua_state);
+	if (watchdog != nullptr && watchdog->depth != 0) {
+		watchdog->check(lua_state);
+	}
+}
+
+void ScriptWatchdog::begin_frame() {
+	frame_instructions = 0;
+	frame_time = {};
+	frame_overrun = false;
+}
+
+void ScriptWatchdog::begin_call(std::string_view actor, std::string_view type, std::string_view callback_name) {
+	depth += 1;
+	if (depth != 1) {
+		return;
+	}
+	actor_name = actor;
+	component_type = type;
+	callback = callback_name;
+	overrun = false;
+	call_instructions = 0;
+	call_start = Clock::now();
+}
+
+bool ScriptWatchdog::end_call() {
+	depth -= 1;
+	if (depth != 0) {
+		return false;
+	}
+	frame_time += Clock::now() - call_start;
+	return overrun && config.policy == WatchdogPolicy::Disable;
+}
+
+void ScriptWatchdog::check(lua_State* lua_state) {
+	const uint64_t interval = static_cast<uint64_t>(config.check_interval);
+	call_instructions += interval;
+	frame_instructions += interval;
+	// already reported; keep raising so a pcall around the loop cannot swallow the abort
+	if (overrun) {
+		if (config.policy != WatchdogPolicy::Report) {
+			luaL_error(lua_state, "watchdog aborted %s.%s", component_type.c_str(), callback.c_str());
+		}
+		return;
+	}
+	const Clock::duration elapsed = Clock::now() - call_start;
+	const double call_ms = std::chrono::duration<double, std::milli>(elapsed).count();
+	const double frame_ms = std::chrono::duration<double, std::milli>(frame_time + elapsed).count();
+
+	const char* budget = nullptr;
+	if (config.call_instructions != 0 && call_instructions > config.call_instructions) {
+		budget = "instruction";
+	} else if (config.call_ms > 0. && call_ms > config.call_ms) {
+		budget = "time";
+	} else if (!frame_overrun && ((config.frame_instructions != 0 && frame_instructions > config.frame_instructions) || (config.frame_ms > 0. && frame_ms > config.frame_ms))) {
+		// only the callback that crosses the frame budget is charged for it
+		budget = "frame";
+		frame_overrun = true;
+	}
+	if (budget == nullptr) {
+		return;
+	}
+
+	overrun = true;
+	{
+		luaL_traceback(lua_state, lua_state, nullptr, 0);
+		std::string traceback = lua_tostring(lua_state, -1);
+		lua_pop(lua_state, 1);
+		std::replace(traceback.begin(), traceback.end(), '\\', '/');
+		std::cout << "\033[31m" << actor_name << " : watchdog: " << component_type << "." << callback << " exceeded the " << budget
+			<< " budget (" << call_instructions << " instructions, " << call_ms << " ms)\n" << traceback << "\033[0m" << std::endl;
+	}
+	// nothing with a destructor may be live here, luaL_error does not unwind C++ frames
+	if (config.policy != WatchdogPolicy::Report) {
+		luaL_error(lua_state, "watchdog aborted %s.%s", component_type.c_str(), callback.c_str());
+	}
+}
+
+bool WorkScheduler::enqueue(Task task) {
+	Sequence sequence = next_sequence;
+	if (!task.key.empty() && !keys.try_emplace(task.key, sequence).second) {
+		return false;
+	}
+	next_sequence += 1;
+	queues[static_cast<size_t>(task.priority)].push_back(sequence);
+	if (task.deadline.has_value()) {
+		deadlines.push({ task.deadline.value(), sequence });
+	}
+	tasks.insert({ sequence, { std::move(task), frame } });
+	return true;
+}
+
+void WorkScheduler::cancel(const std::string& key) {
+	auto it = keys.find(key);
+	if (it == keys.end()) {
+		return;
+	}
+	tasks.erase(it->second);
+	keys.erase(it);
+}
+
+bool WorkScheduler::pending(const std::string& key) const {
+	return keys.count(key) != 0;
+}
+
+size_t WorkScheduler::pending_count() const {
+	return tasks.size();
+}
+
+void WorkScheduler::expedite(ActorId owner) {
+	std::vector<Sequence> owned;
+	for (const auto& [sequence, pending] : tasks) {
+		if (pending.task.owner == owner) {
+			owned.push_back(sequence);
+		}
+	}
+	// in the order they were enqueued, so an actor still starts before the components added to it
+	std::sort(owned.begin(), owned.end());
+	urgent.insert(urgent.end(), owned.begin(), owned.end());
+}
+
+void WorkScheduler::expedite(const std::string& key) {
+	auto it = keys.find(key);
+	if (it != keys.end()) {
+		urgent.push_back(it->second);
+	}
+}
+
+void WorkScheduler::expedite_all() {
+	flush = true;
+}
+
+// false if the task already ran
+bool WorkScheduler::run(Sequence sequence) {
+	auto it = tasks.find(sequence);
+	if (it == tasks.end()) {
+		return false;
+	}
+	Task task = std::move(it->second.task);
+	tasks.erase(it);
+	if (!task.key.empty()) {
+		keys.erase(task.key);
+	}
+	task.run();
+	return true;
+}
+
+void WorkScheduler::drain(uint64_t current_frame) {
+	frame = current_frame;
+	auto start = std::chrono::steady_clock::now();
+	const auto budget = std::chrono::duration<float, std::milli>(budget_ms);
+	bool ran = false;
+
+	while (!urgent.empty()) {
+		Sequence sequence = urgent.front();
+		urgent.pop_front();
+		ran |= run(sequence);
+	}
+	while (!deadlines.empty() && deadlines.top().first <= frame) {
+		Sequence sequence = deadlines.top().second;
+		deadlines.pop();
+		ran |= run(sequence);
+	}
+	// queues are in enqueue order, so only their fronts can have waited too long
+	for (auto& queue : queues) {
+		while (!queue.empty()) {
+			auto it = tasks.find(queue.front());
+			if (it != tasks.end() && it->second.enqueued + max_wait_frames > frame) {
+				break;
+			}
+			queue.pop_front();
+			if (it != tasks.end()) {
+				ran |= run(it->first);
+			}
+		}
+	}
+
+	bool everything = flush;
+	flush = false;
+	for (auto& queue : queues) {
+		while (!queue.empty() && (everything || !ran || std::chrono::steady_clock::now() - start < budget)) {
+			Sequence sequence = queue.front();
+			queue.pop_front();
+			ran |= run(sequence);
+		}
+	}
+	// tasks that ran from the urgent list or at their deadline leave stale entries behind; drop them once the work is done
+	if (tasks.empty()) {
+		for (auto& queue : queues) {
+			queue.clear();
+		}
+		deadlines = {};
+	}
+}
 
 void World::ActorCollection::apply_queue() {
 	std::vector<AddComponentQueue::Descriptor> to_add;
 	component_queue.queue.swap(to_add);
 	for (auto& descriptor : to_add) {
-		auto& lua_actor = *actors[descriptor.actor].actor;
-		if (lua_actor.actor.id != descriptor.id) {
-			continue;
-		}
-		Component& inserted = lua_actor.actor.add_component(std::move(descriptor.component));
-		inserted.lua_component["actor"] = &lua_actor;
-		lua_actor.call_component_method(inserted.lua_component, "OnStart");
+		ActorId id = descriptor.id;
+		work.enqueue({
+			.run = [this, descriptor = std::move(descriptor)]() {
+				LuaActor* lua_actor = actors[descriptor.actor].actor.get();
+				if (lua_actor == nullptr || lua_actor->actor.id != descriptor.id) {
+					return;
+				}
+				Component& inserted = lua_actor->actor.add_component(descriptor.component);
+				inserted.lua_component["actor"] = lua_actor;
+				index_component(descriptor.actor, lua_actor->actor.keys.at(inserted.key));
+				lua_actor->call_component_method(inserted, "OnStart");
+			},
+			.priority = WorkScheduler::Priority::Normal,
+			.deadline = std::nullopt,
+			.owner = id,
+			.key = {},
+		});
 	}
 }
 
+const std::string* World::ActorCollection::coroutine_owner(const CoroutineScheduler::Coroutine& coroutine) const {
+	if (coroutine.actor >= actors.size() || actors[coroutine.actor].actor == nullptr) {
+		return nullptr;
+	}
+	const Actor& actor = actors[coroutine.actor].actor->actor;
+	if (actor.id != coroutine.actor_id) {
+		return nullptr;
+	}
+	luabridge::LuaRef key = coroutine.component["key"];
+	if (!key.isString()) {
+		return nullptr;
+	}
+	auto it = actor.keys.find(key.cast<std::string>());
+	if (it == actor.keys.end() || !actor.components[it->second].lua_component.rawequal(coroutine.component)) {
+		return nullptr;
+	}
+	return &actor.name;
+}
+
 luabridge::LuaRef World::ActorCollection::find(const char* name, lua_State* lua_state) {
 	auto it = names.find(name);
 	if (it == names.end()) {
@@ -863,6 +2768,162 @@ luabridge::LuaRef World::ActorCollection::find_all(const char* name, lua_State*
 	return table;
 }
 
+void World::ActorCollection::index_component(ActorIndex index, ComponentIndex component) {
+	Component& indexed = actors[index].actor->actor.components[component];
+	TypeSet& set = type_sets[indexed.type];
+	indexed.type_slot = static_cast<uint32_t>(set.entries.size());
+	set.entries.push_back({ index, component });
+}
+
+void World::ActorCollection::unindex_component(ActorIndex index, ComponentIndex component) {
+	Component& indexed = actors[index].actor->actor.components[component];
+	if (indexed.type_slot == numeric_max<uint32_t>()) {
+		return;
+	}
+	TypeSet& set = type_sets.at(indexed.type);
+	set.entries[indexed.type_slot].actor = numeric_max<ActorIndex>();
+	set.holes += 1;
+	indexed.type_slot = numeric_max<uint32_t>();
+}
+
+void World::ActorCollection::unindex_actor(ActorIndex index) {
+	if (actors[index].actor == nullptr) {
+		return;
+	}
+	for (ComponentIndex i = 0; i < actors[index].actor->actor.components.size(); i++) {
+		unindex_component(index, i);
+	}
+}
+
+// stable, so the sets stay in the order components were added
+void World::ActorCollection::compact_type_sets() {
+	for (auto& [type, set] : type_sets) {
+		if (set.holes == 0) {
+			continue;
+		}
+		uint32_t kept = 0;
+		for (const TypeEntry& entry : set.entries) {
+			if (entry.actor != numeric_max<ActorIndex>()) {
+				actors[entry.actor].actor->actor.components[entry.component].type_slot = kept;
+				set.entries[kept++] = entry;
+			}
+		}
+		set.entries.resize(kept);
+		set.holes = 0;
+		set.generation += 1;
+	}
+}
+
+luabridge::LuaRef World::ActorCollection::find_all_with_component(const std::string& type, lua_State* lua_state) {
+	auto it = type_sets.find(type);
+	if (it == type_sets.end()) {
+		return luabridge::newTable(lua_state);
+	}
+	const TypeSet& set = it->second;
+	lua_createtable(lua_state, static_cast<int>(set.entries.size() - set.holes), 0);
+	int count = 0;
+	for (const TypeEntry& entry : set.entries) {
+		if (entry.actor != numeric_max<ActorIndex>()) {
+			actors[entry.actor].actor->actor.components[entry.component].lua_component.push();
+			lua_rawseti(lua_state, -2, ++count);
+		}
+	}
+	return luabridge::LuaRef::fromStack(lua_state);
+}
+
+// a generic for iterator over the type's set that yields each component and its actor without building a table
+luabridge::LuaRef World::ActorCollection::each_with_component(const std::string& type, lua_State* lua_state) {
+	auto it = type_sets.find(type);
+	lua_pushlightuserdata(lua_state, this);
+	lua_pushlstring(lua_state, type.data(), type.size());
+	lua_pushinteger(lua_state, 0);
+	lua_pushinteger(lua_state, it == type_sets.end() ? 0 : it->second.generation);
+	lua_pushcclosure(lua_state, &next_with_component, 4);
+	return luabridge::LuaRef::fromStack(lua_state);
+}
+
+// upvalues: the collection, the type, the next position and the generation of the set the position is in
+int World::ActorCollection::next_with_component(lua_State* lua_state) {
+	ActorCollection& collection = *static_cast<ActorCollection*>(lua_touserdata(lua_state, lua_upvalueindex(1)));
+	{
+		auto it = collection.type_sets.find(lua_tostring(lua_state, lua_upvalueindex(2)));
+		if (it == collection.type_sets.end()) {
+			return 0;
+		}
+		const TypeSet& set = it->second;
+		if (set.generation == static_cast<uint32_t>(lua_tointeger(lua_state, lua_upvalueindex(4)))) {
+			for (size_t i = static_cast<size_t>(lua_tointeger(lua_state, lua_upvalueindex(3))); i < set.entries.size(); i++) {
+				const TypeEntry& entry = set.entries[i];
+				if (entry.actor == numeric_max<ActorIndex>()) {
+					continue;
+				}
+				lua_pushinteger(lua_state, static_cast<lua_Integer>(i + 1));
+				lua_replace(lua_state, lua_upvalueindex(3));
+				LuaActor* actor = collection.actors[entry.actor].actor.get();
+				actor->actor.components[entry.component].lua_component.push();
+				luabridge::Stack<LuaActor*>::push(lua_state, actor);
+				return 2;
+			}
+			return 0;
+		}
+	}
+	// nothing with a destructor may be live here, luaL_error does not unwind C++ frames
+	return luaL_error(lua_state, "Actor.EachWithComponent: loop resumed in a later frame; use Actor.FindAllWithComponent for loops that yield");
+}
+
+// actors with a live component of every type, found by walking the smallest set
+luabridge::LuaRef World::ActorCollection::find_all_with_components(luabridge::LuaRef types, lua_State* lua_state) {
+	luabridge::LuaRef table = luabridge::newTable(lua_state);
+	std::vector<std::string> names;
+	for (int i = 1; types.isTable() && types[i].isString(); i++) {
+		names.push_back(types[i].cast<std::string>());
+	}
+	const TypeSet* smallest = nullptr;
+	for (const auto& name : names) {
+		auto it = type_sets.find(name);
+		if (it == type_sets.end()) {
+			return table;
+		}
+		if (smallest == nullptr || it->second.entries.size() - it->second.holes < smallest->entries.size() - smallest->holes) {
+			smallest = &it->second;
+		}
+	}
+	if (smallest == nullptr) {
+		return table;
+	}
+	auto live_of_type = [&](const Actor& actor, const std::string& type) -> ComponentIndex {
+		auto found = actor.types.find(type);
+		if (found != actor.types.end()) {
+			for (ComponentIndex component : found->second) {
+				if (actor.components[component].type_slot != numeric_max<uint32_t>()) {
+					return component;
+				}
+			}
+		}
+		return numeric_max<ComponentIndex>();
+	};
+	int count = 0;
+	for (const TypeEntry& entry : smallest->entries) {
+		if (entry.actor == numeric_max<ActorIndex>()) {
+			continue;
+		}
+		LuaActor* lua_actor = actors[entry.actor].actor.get();
+		const Actor& actor = lua_actor->actor;
+		const std::string& type = actor.components[entry.component].type;
+		// an actor with several components of the walked type is listed at its first
+		if (live_of_type(actor, type) != entry.component) {
+			continue;
+		}
+		bool has_all = std::all_of(names.begin(), names.end(), [&](const std::string& name) {
+			return live_of_type(actor, name) != numeric_max<ComponentIndex>();
+		});
+		if (has_all) {
+			table[++count] = lua_actor;
+		}
+	}
+	return table;
+}
+
 void World::ActorCollection::call_actor_start(ActorIndex from) {
 	ActorIndex next = head;
 	if (from != numeric_max<ActorIndex>()) {
@@ -877,28 +2938,43 @@ void World::ActorCollection::call_actor_start(ActorIndex from) {
 				curr_actor_destroyed = false;
 				break;
 			}
-			luabridge::LuaRef component = lua_actor.actor.components[i].lua_component;
-			lua_actor.call_component_method(component, "OnStart");
+			lua_actor.call_component_method(lua_actor.actor.components[i], "OnStart");
 		}
 		next = actors[curr_actor].next;
 	}
 	curr_actor = numeric_max<ActorIndex>();
 }
 
+// new actors stay out of the update loops until the work scheduler gets to their OnStart
 void World::ActorCollection::call_new_actor_start() {
-	new_actors.clear();
 	std::vector<ActorIndex> actors_to_start;
 	new_actor_list.swap(actors_to_start);
-	for (ActorIndex index : actors_to_start) {
-		if (actors[index].actor.get() == nullptr) {
-			break;
-		}
-		LuaActor& lua_actor = *actors[index].actor;
-		size_t size = lua_actor.actor.components.size();
-		for (size_t i = 0; i < size; i++) {
-			luabridge::LuaRef component = lua_actor.actor.components[i].lua_component;
-			lua_actor.call_component_method(component, "OnStart");
+	for (ActorIndex index : actors_to_start) {
+		if (actors[index].actor.get() == nullptr) {
+			continue;
 		}
+		ActorId id = actors[index].actor->actor.id;
+		work.enqueue({
+			.run = [this, index, id]() {
+				if (actors[index].actor.get() == nullptr || actors[index].actor->actor.id != id) {
+					return;
+				}
+				new_actors.erase(index);
+				start_actor(index);
+			},
+			.priority = WorkScheduler::Priority::Normal,
+			.deadline = std::nullopt,
+			.owner = id,
+			.key = {},
+		});
+	}
+}
+
+void World::ActorCollection::start_actor(ActorIndex index) {
+	LuaActor& lua_actor = *actors[index].actor;
+	size_t size = lua_actor.actor.components.size();
+	for (size_t i = 0; i < size; i++) {
+		lua_actor.call_component_method(lua_actor.actor.components[i], "OnStart");
 	}
 }
 
@@ -919,7 +2995,7 @@ void World::ActorCollection::call_actor_update() {
 				curr_actor_destroyed = false;
 				break;
 			}
-			lua_actor.call_component_method(components[i].lua_component, "OnUpdate");
+			lua_actor.call_component_method(components[i], "OnUpdate");
 		}
 		next = actors[curr_actor].next;
 	}
@@ -942,7 +3018,7 @@ void World::ActorCollection::call_actor_late_update() {
 				curr_actor_destroyed = false;
 				break;
 			}
-			lua_actor.call_component_method(lua_actor.actor.components[i].lua_component, "OnLateUpdate");
+			lua_actor.call_component_method(lua_actor.actor.components[i], "OnLateUpdate");
 		}
 		next = actors[curr_actor].next;
 	}
@@ -963,6 +3039,13 @@ void World::ActorCollection::call_actor_destroy() {
 		next = actors[curr_actor].next;
 	}
 	curr_actor = numeric_max<ActorIndex>();
+	std::vector<std::pair<ActorIndex, ActorId>> inactive;
+	inactive_destroy.swap(inactive);
+	for (auto [index, id] : inactive) {
+		if (actors[index].actor != nullptr && actors[index].actor->actor.id == id) {
+			actors[index].actor->actor.call_destroy();
+		}
+	}
 	for (ActorIndex index : to_destroy) {
 		actors[index].actor->actor.clear();
 		freed_list.push_back(index);
@@ -994,29 +3077,88 @@ ActorIndex World::ActorCollection::raw_add_actor(Actor actor) {
 	auto& name = names[actor.name];
 	if (freed_list.empty() || freed_list.back() == curr_actor) {
 		new_index = static_cast<ActorIndex>(actors.size());
-		actors.push_back({ std::make_unique<LuaActor>(LuaActor{std::move(actor), new_index, *this}), max_index, tail });
+		actors.push_back({ std::make_unique<LuaActor>(LuaActor{std::move(actor), new_index, *this}), max_index, max_index });
 		destroy_on_load.set_len(actors.size(), 0);
 	} else {
 		new_index = freed_list.back();
 		freed_list.pop_back();
-		ActorSlot& slot = actors[new_index];
-		slot.actor = std::make_unique<LuaActor>(LuaActor{ std::move(actor), new_index, *this });
-		slot.next = max_index;
-		slot.prev = tail;
+		actors[new_index].actor = std::make_unique<LuaActor>(LuaActor{ std::move(actor), new_index, *this });
 	}
-	for (auto& component : actors[new_index].actor->actor.components) {
-		component.lua_component["actor"] = actors[new_index].actor.get();
+	auto& components = actors[new_index].actor->actor.components;
+	for (ComponentIndex i = 0; i < components.size(); i++) {
+		if (!components[i].lua_component.isNil()) {
+			components[i].lua_component["actor"] = actors[new_index].actor.get();
+			index_component(new_index, i);
+		}
 	}
 	destroy_on_load.set(new_index, true);
+	link(new_index);
+	name.push_back(new_index);
+	return new_index;
+}
+
+void World::ActorCollection::link(ActorIndex index) {
+	ActorSlot& slot = actors[index];
+	slot.next = numeric_max<ActorIndex>();
+	slot.prev = tail;
+	slot.linked = true;
 	if (tail != numeric_max<ActorIndex>()) {
-		actors[tail].next = new_index;
+		actors[tail].next = index;
 	}
 	if (head == numeric_max<ActorIndex>()) {
-		head = new_index;
+		head = index;
+	}
+	tail = index;
+}
+
+// Leaves slot.next intact so a walk currently visiting this actor can still step past it
+void World::ActorCollection::unlink(ActorIndex index) {
+	ActorSlot& slot = actors[index];
+	slot.linked = false;
+	if (slot.next == numeric_max<ActorIndex>()) {
+		tail = slot.prev;
+	} else {
+		actors[slot.next].prev = slot.prev;
+	}
+	if (slot.prev == numeric_max<ActorIndex>()) {
+		head = slot.next;
+	} else {
+		actors[slot.prev].next = slot.next;
+	}
+
+	if (curr_actor == index) {
+		curr_actor_destroyed = true;
+	}
+
+	if (curr_actor != numeric_max<ActorIndex>() && index == actors[curr_actor].next) {
+		actors[curr_actor].next = slot.next;
+	}
+}
+
+void World::ActorCollection::set_active(ActorIndex index, bool active) {
+	Actor& actor = actors[index].actor->actor;
+	if (actor.active == active) {
+		return;
+	}
+	actor.active = active;
+	if (!active) {
+		if (actors[index].linked) {
+			unlink(index);
+		}
+	} else {
+		to_activate.push_back({ index, actor.id });
+	}
+}
+
+void World::ActorCollection::apply_activations() {
+	std::vector<std::pair<ActorIndex, ActorId>> activations;
+	to_activate.swap(activations);
+	for (auto [index, id] : activations) {
+		ActorSlot& slot = actors[index];
+		if (slot.actor != nullptr && slot.actor->actor.id == id && slot.actor->actor.active && !slot.linked) {
+			link(index);
+		}
 	}
-	tail = new_index;
-	name.push_back(new_index);
-	return new_index;
 }
 
 void World::clear_scene() {
@@ -1026,13 +3168,26 @@ void World::clear_scene() {
 		}
 	}
 	actors.call_actor_destroy();
+	coroutines.purge([&](const CoroutineScheduler::Coroutine& coroutine) { return actors.coroutine_owner(coroutine); });
+	templates.clear_prototypes();
 	next_scene = {};
+	next_async_scene = {};
+	next_restore = {};
+	stop_streaming();
 }
 
 void World::update_actors() {
+	watchdog.begin_frame();
+	actors.compact_type_sets();
+	coroutines.advance(*frame_number, static_cast<double>(SDL_GetTicks64()) / 1000.);
+	actors.apply_activations();
 	actors.call_new_actor_start();
 	actors.apply_queue();
+	work.drain(*frame_number);
 	actors.call_actor_update();
+	coroutines.resume_due(lua_state, [&](const CoroutineScheduler::Coroutine& coroutine) {
+		return actors.coroutine_owner(coroutine);
+	});
 	actors.call_actor_late_update();
 	actors.call_actor_destroy();
 }
@@ -1091,7 +3246,8 @@ World::World(std::shared_ptr<GameConfig> game_config, std::shared_ptr<Renderer>
 	: config(game_config),
 	renderer(renderer),
 	templates(renderer, lua_state),
-	actors(templates),
+	work(game_config->work_budget_ms, game_config->work_max_wait_frames),
+	actors(templates, work),
 	lua_state(lua_state) {}
 
 void World::actor_destroy(LuaActor actor) {
@@ -1103,6 +3259,8 @@ void World::actor_destroy(LuaActor actor) {
 	auto& actors_list = actors.actors;
 
 	actors.destroy_on_load.set(actor.index, false);
+	actors.new_actors.erase(actor.index);
+	actors.unindex_actor(actor.index);
 	auto& name = actors.names[actor.actor.name];
 	name.erase(std::find(name.begin(), name.end(), actor.index));
 	if (name.size() == 0) {
@@ -1117,23 +3275,8 @@ void World::actor_destroy(LuaActor actor) {
 		slot.actor->actor.clear();
 		slot.actor = nullptr;
 	}
-	if (slot.next == numeric_max<ActorIndex>()) {
-		actors.tail = slot.prev;
-	} else {
-		actors_list[slot.next].prev = slot.prev;
-	}
-	if (slot.prev == numeric_max<ActorIndex>()) {
-		actors.head = slot.next;
-	} else {
-		actors_list[slot.prev].next = slot.next;
-	}
-
-	if (actors.curr_actor == actor.index) {
-		actors.curr_actor_destroyed = true;
-	}
-
-	if (actors.curr_actor != numeric_max<ActorIndex>() && actor.index == actors.actors[actors.curr_actor].next) {
-		actors.actors[actors.curr_actor].next = slot.next;
+	if (slot.linked) {
+		actors.unlink(actor.index);
 	}
 }
 
@@ -1280,8 +3423,10 @@ bool World::map_key_func(bool(InputManager::*func)(SDL_Scancode) const, const ch
 }
 
 World::World(std::shared_ptr<GameConfig> game_config, lua_State* lua_state) : World(game_config, std::make_shared<Renderer>(Renderer(game_config)), lua_state) {
+	StartupPreloader::mark("renderer and audio ready");
 	frame_number = std::make_unique<uint64_t>(0);
 	uint64_t* frame_count_ptr = frame_number.get();
+	watchdog.install(lua_state, config->watchdog);
 	luabridge::getGlobalNamespace(lua_state)
 		.beginNamespace("Debug")
 			.addFunction("Log", static_cast<void(*)(std::string message)>([](std::string message) {std::cout << message << '\n'; }))
@@ -1303,6 +3448,10 @@ World::World(std::shared_ptr<GameConfig> game_config, lua_State* lua_state) : Wo
 			.addFunction("GetComponents", &LuaActor::get_components_by_type)
 			.addFunction("AddComponent", &LuaActor::add_component)
 			.addFunction("RemoveComponent", &LuaActor::remove_component)
+			.addFunction("SetEnabled", &LuaActor::set_enabled)
+			.addFunction("IsEnabled", &LuaActor::is_enabled)
+			.addFunction("SetActive", &LuaActor::set_active)
+			.addFunction("IsActive", &LuaActor::is_active)
 		.endClass()
 		.beginClass<glm::vec2>("vec2")
 			.addConstructor<void(*)(float, float)>()
@@ -1390,10 +3539,18 @@ World::World(std::shared_ptr<GameConfig> game_config, lua_State* lua_state) : Wo
 		.beginClass<Model>("Model")
 			.addProperty("key", &Model::key)
 			.addProperty("actor", &Model::actor)
-			.addProperty("enabled", &Model::enabled)
+			.addProperty("enabled", std::function<bool(const Model*)>([](const Model* model) {return model->enabled; }), std::function<void(Model*, bool)>([](Model* model, bool enabled) {
+				LuaActor* owner = model->actor.isNil() ? nullptr : model->actor.cast<LuaActor*>();
+				if (owner != nullptr) {
+					owner->set_enabled_by_key(model->key, enabled);
+				} else {
+					model->enabled = enabled;
+				}
+			}))
 			.addProperty("type", std::function<const char* (const Model*)>([](const Model*) {return "Model"; }), std::function<void(Model*, const char*)>([](Model*, const char*) {}))
 			.addProperty("__index", std::function<luabridge::LuaRef(const Model*)>([](const Model* model) {return luabridge::LuaRef{ model->actor.state()}; }), std::function<void(Model*, luabridge::LuaRef)>([](const Model*, luabridge::LuaRef) {}))
 			.addProperty("mesh", std::function<const char*(const Model*)>([](const Model* model) {return model->mesh.c_str(); }), std::function<void(Model*, const char*)>([](Model* model, const char* mesh) {model->mesh = mesh; model->mesh_dirty = true; }))
+			.addProperty("static", std::function<bool(const Model*)>([](const Model* model) {return model->is_static; }), std::function<void(Model*, bool)>([](Model* model, bool is_static) {model->mesh_dirty |= model->is_static != is_static; model->is_static = is_static; }))
 			.addProperty("transform", std::function<Transform(const Model*)>([](const Model* model) {return model->transform; }), std::function<void(Model*, Transform)>([](Model* model, Transform transform) {model->transform = transform; model->transform_dirty = true; }))
 			.addProperty("translation", std::function<glm::vec3(const Model*)>([](const Model* model) {return model->transform.translation; }), std::function<void(Model*, glm::vec3)>([](Model* model, glm::vec3 translation) {model->transform.translation = translation; model->transform_dirty = true; }))
 			.addProperty("translation_x", std::function<float(const Model*)>([](const Model* model) {return model->transform.translation.x; }), std::function<void(Model*, float)>([](Model* model, float x) {model->transform.translation.x = x; model->transform_dirty = true; }))
@@ -1410,17 +3567,30 @@ World::World(std::shared_ptr<GameConfig> game_config, lua_State* lua_state) : Wo
 			.addFunction("OnStart", &Model::on_start)
 			.addFunction("OnUpdate", &Model::on_update)
 			.addFunction("OnDestroy", &Model::on_destroy)
+			.addStaticFunction("SetTransforms", &Model::set_transforms)
+			.addStaticFunction("SetTranslations", &Model::set_translations)
 		.endClass()
 		.beginClass<Camera>("_CameraType")
 			.addProperty("transform", std::function<Transform(const Camera*)>([](const Camera* camera) {return luabridge::getGlobal(camera->lua_state, "_Renderer").cast<const Renderer*>()->getCameraTransform(); }), std::function<void(Camera*, Transform)>([](Camera* camera, Transform transform) {luabridge::getGlobal(camera->lua_state, "_Renderer").cast<Renderer*>()->getCameraTransform() = transform; }))
+			.addProperty("visible_instances", std::function<uint32_t(const Camera*)>([](const Camera* camera) {return static_cast<uint32_t>(luabridge::getGlobal(camera->lua_state, "_Renderer").cast<const Renderer*>()->getCullStats().visible); }))
+			.addProperty("culled_instances", std::function<uint32_t(const Camera*)>([](const Camera* camera) {return static_cast<uint32_t>(luabridge::getGlobal(camera->lua_state, "_Renderer").cast<const Renderer*>()->getCullStats().culled); }))
+			.addProperty("draw_calls", std::function<uint32_t(const Camera*)>([](const Camera* camera) {return static_cast<uint32_t>(luabridge::getGlobal(camera->lua_state, "_Renderer").cast<const Renderer*>()->getRenderStats().draws); }))
+			.addProperty("state_changes", std::function<uint32_t(const Camera*)>([](const Camera* camera) {return static_cast<uint32_t>(luabridge::getGlobal(camera->lua_state, "_Renderer").cast<const Renderer*>()->getRenderStats().binds); }))
+			.addProperty("skipped_state_changes", std::function<uint32_t(const Camera*)>([](const Camera* camera) {return static_cast<uint32_t>(luabridge::getGlobal(camera->lua_state, "_Renderer").cast<const Renderer*>()->getRenderStats().skipped); }))
+			.addProperty("bundle_hits", std::function<uint32_t(const Camera*)>([](const Camera* camera) {return static_cast<uint32_t>(luabridge::getGlobal(camera->lua_state, "_Renderer").cast<const Renderer*>()->getRenderStats().bundle_hits); }))
+			.addProperty("bundle_misses", std::function<uint32_t(const Camera*)>([](const Camera* camera) {return static_cast<uint32_t>(luabridge::getGlobal(camera->lua_state, "_Renderer").cast<const Renderer*>()->getRenderStats().bundle_misses); }))
 		.endClass()
 		.beginClass<ActorCollection>("_ActorCollection").endClass()
 		.beginClass<InputManager>("_InputManager").endClass()
 		.beginClass<Renderer>("_RendererType").endClass()
 		.beginClass<AudioManager>("_AudioManager").endClass()
+		.beginClass<WorkScheduler>("_WorkScheduler").endClass()
 		.beginNamespace("Actor")
 			.addFunction("Find", std::function<luabridge::LuaRef(const char*)>([&, lua_state](const char* name) {return actors.find(name, lua_state); }))
 			.addFunction("FindAll", std::function<luabridge::LuaRef(const char*)>([&, lua_state](const char* name) {return actors.find_all(name, lua_state); }))
+			.addFunction("FindAllWithComponent", std::function<luabridge::LuaRef(std::string)>([&, lua_state](std::string type) {return actors.find_all_with_component(type, lua_state); }))
+			.addFunction("EachWithComponent", std::function<luabridge::LuaRef(std::string)>([&, lua_state](std::string type) {return actors.each_with_component(type, lua_state); }))
+			.addFunction("FindAllWithComponents", std::function<luabridge::LuaRef(luabridge::LuaRef)>([&, lua_state](luabridge::LuaRef types) {return actors.find_all_with_components(types, lua_state); }))
 			.addFunction("Instantiate", std::function<luabridge::LuaRef(const char*)>([&, lua_state](const char* name) {return actors.instantiate(name, lua_state); }))
 			.addFunction("Destroy", std::function<void(LuaActor)>([&](LuaActor actor) {actor_destroy(actor); }))
 		.endNamespace()
@@ -1435,20 +3605,89 @@ World::World(std::shared_ptr<GameConfig> game_config, lua_State* lua_state) : Wo
 			.addFunction("GetMouseScrollDelta", std::function<float(lua_State*)>([&](lua_State*) {return inputs.get_scroll_delta(); }))
 		.endNamespace()
 		.beginNamespace("Audio")
-			.addFunction("Play", std::function<void(int, std::string, bool)>([&](int channel, std::string clip_name, bool does_loop) {audio_manager.play_sound(audio_manager.load_sound(clip_name), channel, does_loop); }))
-			.addFunction("Halt", std::function<void(int)>([&](int channel) {return audio_manager.stop_sound(channel); }))
+			.addFunction("Play", std::function<void(int, std::string, bool)>([&](int channel, std::string clip_name, bool does_loop) {
+				// a later Play replaces a deferred one on the same channel
+				const std::string key = "Audio.Play " + std::to_string(channel);
+				work.cancel(key);
+				if (audio_manager.is_loaded(clip_name)) {
+					audio_manager.play_sound(audio_manager.load_sound(clip_name), channel, does_loop);
+					return;
+				}
+				// decoding a clip the first time goes through the work scheduler, at most two frames late
+				work.enqueue({
+					.run = [this, channel, clip_name, does_loop]() {
+						audio_manager.play_sound(audio_manager.load_sound(clip_name), channel, does_loop);
+					},
+					.priority = WorkScheduler::Priority::High,
+					.deadline = *frame_number + 2,
+					.owner = std::nullopt,
+					.key = key,
+				});
+			}))
+			.addFunction("Halt", std::function<void(int)>([&](int channel) {
+				// SetVolume needs no such care: Mix_Volume keeps a channel's volume across plays
+				work.cancel("Audio.Play " + std::to_string(channel));
+				audio_manager.stop_sound(channel);
+			}))
 			.addFunction("SetVolume", std::function<void(int, float)>([&](int channel, float volume) {return audio_manager.set_volume(channel, static_cast<int>(volume)); }))
 		.endNamespace()
 		.beginNamespace("Scene")
 			.addFunction("Load", std::function<void(std::string)>([&](std::string scene_name) { next_scene = { scene_name }; }))
+			.addFunction("LoadAsync", std::function<void(std::string)>([&](std::string scene_name) { next_async_scene = { scene_name }; }))
+			.addFunction("GetLoadProgress", std::function<float()>([&]() {return scene_load_progress(); }))
 			.addFunction("GetCurrent", std::function<std::string()>([&]() {return current_scene; }))
+			.addFunction("Snapshot", std::function<uint32_t(lua_State*)>([&](lua_State* from) {
+				uint32_t handle = take_snapshot();
+				if (handle == 0) {
+					// take_snapshot left the message on the main state
+					lua_xmove(lua_state, from, 1);
+					lua_error(from);
+				}
+				return handle;
+			}))
+			.addFunction("Restore", std::function<void(uint32_t)>([&](uint32_t handle) { next_restore = { handle }; }))
+			.addFunction("DiscardSnapshot", std::function<void(uint32_t)>([&](uint32_t handle) { snapshots.erase(handle); }))
 			.addFunction("DontDestroy", std::function<void(luabridge::LuaRef)>([&](luabridge::LuaRef lua_actor) {actors.dont_destroy_on_load(lua_actor.cast<LuaActor>().index); }))
 		.endNamespace()
+		.beginNamespace("Work")
+			.addFunction("Expedite", std::function<void(LuaActor*, lua_State*)>([&](LuaActor* lua_actor, lua_State* from) {
+				if (lua_actor == nullptr) {
+					luaL_error(from, "Work.Expedite: expected an actor, got nil");
+				}
+				work.expedite(lua_actor->actor.id);
+			}))
+			.addFunction("ExpediteMesh", std::function<void(std::string)>([&](std::string mesh) {work.expedite(translate_path("resources/meshes/") + mesh); }))
+			.addFunction("Flush", std::function<void()>([&]() {work.expedite_all(); }))
+			.addFunction("GetPending", std::function<uint32_t()>([&]() {return static_cast<uint32_t>(work.pending_count()); }))
+		.endNamespace()
 		.beginNamespace("Event")
-			.addFunction("Publish", std::function<void(std::string, luabridge::LuaRef)>([&](std::string event_type, luabridge::LuaRef message) {events.publish(event_type, message); }))
+			.addFunction("Publish", std::function<void(std::string, luabridge::LuaRef)>([&](std::string event_type, luabridge::LuaRef message) {events.publish(event_type, message); coroutines.notify_event(event_type); }))
 			.addFunction("Subscribe", std::function<void(std::string, luabridge::LuaRef, luabridge::LuaRef)>([&](std::string event_type, luabridge::LuaRef component, luabridge::LuaRef function) {events.schedule_subscribe(event_type, component, function); }))
 			.addFunction("Unsubscribe", std::function<void(std::string, luabridge::LuaRef, luabridge::LuaRef)>([&](std::string event_type, luabridge::LuaRef component, luabridge::LuaRef function) {events.schedule_unsubscribe(event_type, component, function); }))
 		.endNamespace()
+		.beginClass<WaitCondition>("_WaitCondition").endClass()
+		.beginNamespace("Coroutine")
+			.addFunction("Start", std::function<CoroutineScheduler::Id(luabridge::LuaRef, luabridge::LuaRef, lua_State*)>([&](luabridge::LuaRef component, luabridge::LuaRef function, lua_State* from) {
+				LuaActor* actor = component["actor"].cast<LuaActor*>();
+				if (actor == nullptr || !function.isFunction()) {
+					std::cout << "\033[31mCoroutine.Start requires a component attached to an actor and a function\033[0m" << std::endl;
+					return CoroutineScheduler::Id{ 0 };
+				}
+				CoroutineScheduler::Coroutine coroutine = {
+					.thread = luabridge::LuaRef(from),
+					.component = component,
+					.actor = actor->index,
+					.actor_id = actor->actor.id,
+					.waiting = std::nullopt,
+					.event = {},
+				};
+				return coroutines.start(from, std::move(coroutine), function, actor->actor.name);
+			}))
+			.addFunction("Stop", std::function<void(CoroutineScheduler::Id)>([&](CoroutineScheduler::Id id) {coroutines.stop(id); }))
+			.addFunction("WaitFrames", std::function<WaitCondition(uint64_t)>([](uint64_t frames) {return WaitCondition{ .kind = WaitCondition::Kind::Frames, .frames = frames, .seconds = 0., .event = {} }; }))
+			.addFunction("WaitSeconds", std::function<WaitCondition(double)>([](double seconds) {return WaitCondition{ .kind = WaitCondition::Kind::Seconds, .frames = 0, .seconds = seconds, .event = {} }; }))
+			.addFunction("WaitEvent", std::function<WaitCondition(std::string)>([](std::string event_type) {return WaitCondition{ .kind = WaitCondition::Kind::Event, .frames = 0, .seconds = 0., .event = std::move(event_type) }; }))
+		.endNamespace()
 		.beginNamespace("Math")
 			.addFunction("Random", std::function<float(float, float)>([](float min, float max) {return min + static_cast<float>(rand()) / (static_cast<float>(static_cast<float>(RAND_MAX) / (max - min))); }))
 			.addFunction("Rotate", std::function<glm::vec3(glm::vec3, glm::vec3)>([](glm::vec3 vec, glm::vec3 rot) {
@@ -1466,37 +3705,757 @@ World::World(std::shared_ptr<GameConfig> game_config, lua_State* lua_state) : Wo
 		.endNamespace();
 
 	luabridge::setGlobal(lua_state, renderer.get(), "_Renderer");
+	luabridge::setGlobal(lua_state, &work, "_WorkScheduler");
 	luabridge::setGlobal(lua_state, new Camera(lua_state), "Camera");
-	load_scene(config->initial_scene);
+	load_scene(config->initial_scene, false);
+	StartupPreloader::mark("initial scene loaded");
+	StartupPreloader::join(*renderer);
 }
 
-void World::load_scene(std::string scene_name) {
+void World::load_scene(std::string scene_name, bool preload) {
+	cancel_scene_load();
 	clear_scene();
 	current_scene = scene_name;
 
-	std::string scene_path = translate_path("resources/scenes/") + scene_name + ".scene";
-	if (!file_exists(scene_path)) {
+	std::unique_ptr<SceneLoad> load = open_scene(scene_name);
+	load->preload = preload;
+	read_scene(*load, *renderer);
+	if (preload) {
+		while (preload_next(*load)) {}
+		report_preload(*load);
+	}
+	if (load->streamed) {
+		start_streaming(std::move(load));
+		return;
+	}
+	for (uint32_t i = 0; i < load->actor_count; i++) {
+		actors.add_actor(create_scene_actor(*load, i));
+	}
+}
+
+std::unique_ptr<World::SceneLoad> World::open_scene(const std::string& scene_name) const {
+	auto load = std::make_unique<SceneLoad>();
+	load->name = scene_name;
+	load->path = translate_path("resources/scenes/") + scene_name + ".scene";
+	load->use_cooked = prefer_cooked(load->path) && load->cooked_scene.open(load->path + "c") && load->cooked_scene.header().kind == cooked::Kind::Scene
+		&& cooked_dependencies_current(load->cooked_scene);
+	load->streamed = config->streaming.scenes.count(scene_name) != 0;
+	load->budget_bytes = config->preload_budget_mb * 1024 * 1024;
+	if (!load->use_cooked && !file_exists(load->path)) {
 		std::cout << "error: scene " << scene_name << " is missing";
 		exit(0);
 	}
+	return load;
+}
+
+Actor World::create_scene_actor(const SceneLoad& load, uint32_t record) {
+	return load.use_cooked ? templates.create_actor(load.cooked_scene, record) : templates.create_actor(load.json->doc()["actors"][record]);
+}
+
+void World::load_scene_async(std::string scene_name) {
+	cancel_scene_load();
+	next_async_scene = {};
+	std::unique_ptr<SceneLoad> load = open_scene(scene_name);
+#ifdef __EMSCRIPTEN__
+	// no threads without pthread support; the read happens when the first step waits on it
+	load->worker = std::async(std::launch::deferred, read_scene, std::ref(*load), std::ref(*renderer));
+#else
+	load->worker = std::async(std::launch::async, read_scene, std::ref(*load), std::ref(*renderer));
+#endif
+	scene_load = std::move(load);
+}
+
+// runs on the loader's worker (or the main thread for Scene.Load); must not touch Lua or anything else owned by the main thread
+void World::read_scene(SceneLoad& load, Renderer& renderer) {
+	if (!load.use_cooked) {
+		// the DOM outlives this thread, so it cannot borrow the thread's arena
+		load.json = std::make_unique<JsonFile>(load.path, false);
+	}
+	load.actor_count = load.use_cooked ? load.cooked_scene.actor_count() : load.json->doc()["actors"].Size();
+	if (!load.preload) {
+		load.read_done = true;
+		return;
+	}
+	load.manifest = SceneManifest::scan(load.use_cooked ? &load.cooked_scene : nullptr, load.use_cooked ? nullptr : &load.json->doc());
+	// a streamed scene decodes meshes cell by cell as the camera approaches
+	if (load.streamed) {
+		load.manifest.meshes.clear();
+	}
+	const std::vector<std::string>& meshes = load.manifest.meshes;
+	const std::vector<SceneManifest::Clip>& clips = load.manifest.audio;
+	load.prepared.assign(meshes.size() + clips.size(), 0);
+	load.clip_bytes.resize(clips.size());
+	load.mesh_count = static_cast<uint32_t>(meshes.size());
+	load.read_done = true;
+
+	// meshes first, then clips; whatever is past the budget once a worker gets to it is left for its first use.
+	// Workers check the budget before decoding and claim the bytes after; only the claim that crosses the budget keeps
+	// its result, the others drop theirs as if the budget had already been spent when they started
+	std::atomic<size_t> next_job = 0;
+	auto prepare = [&]() {
+		for (size_t i = next_job++; i < load.prepared.size() && !load.cancelled; i = next_job++) {
+			bool fits = load.preloaded_bytes < load.budget_bytes;
+			if (i < meshes.size()) {
+				if (fits) {
+					size_t bytes = renderer.prefetchModel(meshes[i]);
+					if (bytes != 0 && load.preloaded_bytes.fetch_add(bytes) >= load.budget_bytes) {
+						load.preloaded_bytes -= bytes;
+						renderer.discardDecodedModels({ meshes[i] });
+						fits = false;
+					}
+				}
+				load.meshes_decoded += 1;
+			} else if (fits) {
+				std::string& bytes = load.clip_bytes[i - meshes.size()];
+				bytes = read_file_bytes(clips[i - meshes.size()].path, false);
+				if (load.preloaded_bytes.fetch_add(bytes.size()) >= load.budget_bytes) {
+					load.preloaded_bytes -= bytes.size();
+					bytes = {};
+					fits = false;
+				}
+			}
+			load.prepared[i] = fits;
+		}
+	};
+#ifdef __EMSCRIPTEN__
+	prepare();
+#else
+	std::vector<std::thread> workers;
+	size_t extra_threads = load.prepared.empty() ? 0 : std::min<size_t>(load.prepared.size(), std::max(std::thread::hardware_concurrency(), 1u)) - 1;
+	for (size_t i = 0; i < extra_threads; i++) {
+		workers.emplace_back(prepare);
+	}
+	prepare();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+#endif
+}
+
+// loads one manifest entry on the main thread: a component type, a template, a clip or a mesh upload, in that order;
+// returns false once there is nothing left
+bool World::preload_next(SceneLoad& load) {
+	const SceneManifest& manifest = load.manifest;
+	const size_t first_template = manifest.components.size();
+	const size_t first_clip = first_template + manifest.templates.size();
+	const size_t first_mesh = first_clip + manifest.audio.size();
+	const size_t i = load.next_preload;
+	if (i >= first_mesh + manifest.meshes.size()) {
+		return false;
+	}
+	load.next_preload += 1;
+
+	if (i < first_clip) {
+		// what scripts and templates add to the Lua heap counts against the budget too
+		size_t before = static_cast<size_t>(lua_gc(lua_state, LUA_GCCOUNT, 0));
+		if (i < first_template) {
+			templates.preload_component(manifest.components[i]);
+		} else {
+			templates.preload_template(manifest.templates[i - first_template]);
+		}
+		size_t after = static_cast<size_t>(lua_gc(lua_state, LUA_GCCOUNT, 0));
+		load.preloaded_bytes += after > before ? (after - before) * 1024 : 0;
+	} else if (i < first_mesh) {
+		const SceneManifest::Clip& clip = manifest.audio[i - first_clip];
+		std::string bytes = std::move(load.clip_bytes[i - first_clip]);
+		if (!load.prepared[manifest.meshes.size() + i - first_clip]) {
+			load.skipped += 1;
+			return true;
+		}
+		// the file only counts until it is decoded
+		load.preloaded_bytes -= bytes.size();
+		if (audio_manager.is_loaded(clip.name)) {
+			return true;
+		}
+		if (load.preloaded_bytes >= load.budget_bytes) {
+			load.skipped += 1;
+		} else if (Mix_Chunk* chunk = audio_manager.load_sound(clip.name, bytes)) {
+			load.preloaded_bytes += chunk->alen;
+		}
+	} else if (load.prepared[i - first_mesh]) {
+		renderer->loadModel(manifest.meshes[i - first_mesh]);
+	} else {
+		load.skipped += 1;
+	}
+	return true;
+}
+
+void World::report_preload(const SceneLoad& load) const {
+	const SceneManifest& manifest = load.manifest;
+	std::cout << "Preloaded scene " << load.name << ": " << manifest.templates.size() << " templates, " << manifest.components.size() << " component types, "
+		<< manifest.meshes.size() << " meshes, " << manifest.audio.size() << " audio clips, " << (load.preloaded_bytes + 1024 * 1024 - 1) / (1024 * 1024) << " MB";
+	if (load.skipped != 0) {
+		std::cout << " (" << load.skipped << " left for first use, over the " << config->preload_budget_mb << " MB budget)";
+	}
+	std::cout << std::endl;
+}
+
+void World::cancel_scene_load() {
+	if (!scene_load) {
+		return;
+	}
+	SceneLoad& load = *scene_load;
+	load.cancelled = true;
+	// a deferred read (web build) that never started has decoded nothing, and waiting on it would run it
+	if (load.worker.valid() && load.worker.wait_for(std::chrono::seconds(0)) != std::future_status::deferred) {
+		load.worker.wait();
+	}
+	// the meshes the workers got to would otherwise stay decoded in the renderer until something loads them
+	std::vector<std::string> prefetched;
+	for (size_t i = 0; i < load.manifest.meshes.size() && i < load.prepared.size(); i++) {
+		if (load.prepared[i]) {
+			prefetched.push_back(load.manifest.meshes[i]);
+		}
+	}
+	renderer->discardDecodedModels(prefetched);
+	scene_load.reset();
+}
+
+// the old scene stays up until the worker is done and the manifest is loaded; then actors are created and started until
+// the frame budget runs out
+void World::step_scene_load() {
+	if (!scene_load) {
+		return;
+	}
+	SceneLoad& load = *scene_load;
+	auto start = std::chrono::steady_clock::now();
+	const auto budget = std::chrono::duration<float, std::milli>(config->scene_load_budget_ms);
+	if (!load.instantiating) {
+		if (load.worker.valid()) {
+			if (load.worker.wait_for(std::chrono::seconds(0)) == std::future_status::timeout) {
+				return;
+			}
+			load.worker.get();
+		}
+		// the manifest is loaded within the same budget while the old scene is still up
+		while (preload_next(load)) {
+			if (std::chrono::steady_clock::now() - start >= budget) {
+				return;
+			}
+		}
+		report_preload(load);
+		clear_scene();
+		current_scene = load.name;
+		if (load.streamed) {
+			start_streaming(std::move(scene_load));
+			publish_scene_loaded(current_scene);
+			return;
+		}
+		load.instantiating = true;
+	}
+	while (load.next_actor < load.actor_count) {
+		Actor actor = create_scene_actor(load, load.next_actor);
+		load.next_actor += 1;
+		actors.start_actor(actors.raw_add_actor(std::move(actor)));
+		if (std::chrono::steady_clock::now() - start >= budget) {
+			return;
+		}
+	}
+	std::string name = load.name;
+	scene_load.reset();
+	publish_scene_loaded(name);
+}
+
+void World::publish_scene_loaded(const std::string& scene_name) {
+	events.publish("SceneLoaded", luabridge::LuaRef(lua_state, scene_name));
+	coroutines.notify_event("SceneLoaded");
+}
+
+static glm::ivec2 tile_of(glm::vec2 position) {
+	return glm::ivec2(glm::floor(position / coord_tile_fsize));
+}
+
+static std::optional<glm::vec2> ground_position(const Actor& actor) {
+	for (const auto& component : actor.components) {
+		if (component.type == "Model") {
+			const Model* model = component.lua_component.cast<Model*>();
+			return glm::vec2{ model->transform.translation.x, model->transform.translation.z };
+		}
+	}
+	return {};
+}
+
+// sorts every positioned actor into its tile; the cells themselves are instantiated by step_streaming
+void World::start_streaming(std::unique_ptr<SceneLoad> source) {
+	auto stream = std::make_unique<SceneStreaming>();
+	for (uint32_t i = 0; i < source->actor_count; i++) {
+		TemplateManager::Placement placement = source->use_cooked
+			? templates.placement(source->cooked_scene, i)
+			: templates.placement(source->json->doc()["actors"][i]);
+		if (!placement.position.has_value()) {
+			actors.add_actor(create_scene_actor(*source, i));
+			continue;
+		}
+		glm::ivec2 cell = tile_of(placement.position.value());
+		stream->cells[cell].push_back(i);
+		auto& meshes = stream->cell_meshes[cell];
+		for (auto& mesh : placement.meshes) {
+			if (std::find(meshes.begin(), meshes.end(), mesh) == meshes.end()) {
+				meshes.push_back(std::move(mesh));
+			}
+		}
+	}
+	stream->source = std::move(source);
+	streaming = std::move(stream);
+}
+
+void World::unload_cell(SceneStreaming& stream, SceneStreaming::CellState& cell) {
+	const int unload_radius = config->streaming.unload_radius;
+	for (const auto& spawned : cell.spawned) {
+		const auto& slot = actors.actors[spawned.index];
+		if (slot.actor.get() == nullptr || slot.actor->actor.id != spawned.id || actors.to_destroy.count(spawned.index) != 0) {
+			stream.retired.insert(spawned.record);
+			continue;
+		}
+		// an actor that moved away from its cell stays as long as it is still in range
+		std::optional<glm::vec2> position = ground_position(slot.actor->actor);
+		if (position.has_value()) {
+			glm::ivec2 offset = glm::abs(tile_of(position.value()) - stream.camera_cell.value());
+			if (std::max(offset.x, offset.y) <= unload_radius) {
+				stream.retired.insert(spawned.record);
+				continue;
+			}
+		}
+		actor_destroy(*slot.actor);
+	}
+	cell.spawned.clear();
+
+	if (cell.cancelled) {
+		*cell.cancelled = true;
+	}
+	if (cell.decoding.valid() && cell.decoding.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+		stream.discarding.push_back({ std::move(cell.decoding), std::move(cell.prefetched) });
+	} else {
+		discard_cell_meshes(stream, cell.prefetched);
+	}
+	cell.prefetched.clear();
+}
+
+// drops decoded meshes that were never uploaded, except those a cell still in range is waiting for
+void World::discard_cell_meshes(SceneStreaming& stream, const std::vector<std::string>& paths) {
+	std::unordered_set<std::string> wanted;
+	for (const auto& [position, cell] : stream.loaded) {
+		wanted.insert(cell.prefetched.begin(), cell.prefetched.end());
+	}
+	std::vector<std::string> unused;
+	for (const auto& path : paths) {
+		if (wanted.count(path) == 0) {
+			unused.push_back(path);
+		}
+	}
+	renderer->discardDecodedModels(unused);
+}
+
+void World::stop_streaming() {
+	if (!streaming) {
+		return;
+	}
+	SceneStreaming& stream = *streaming;
+	std::vector<std::string> paths;
+	for (auto& [position, cell] : stream.loaded) {
+		if (cell.cancelled) {
+			*cell.cancelled = true;
+		}
+		if (cell.decoding.valid()) {
+			cell.decoding.wait();
+		}
+		paths.insert(paths.end(), cell.prefetched.begin(), cell.prefetched.end());
+	}
+	for (auto& pending : stream.discarding) {
+		pending.decoding.wait();
+		paths.insert(paths.end(), pending.paths.begin(), pending.paths.end());
+	}
+	renderer->discardDecodedModels(paths);
+	streaming.reset();
+}
+
+// when the camera changes tile, cells past unload_radius are destroyed and cells within load_radius are queued;
+// queued cells are then instantiated nearest first within the scene load budget
+void World::step_streaming() {
+	if (!streaming) {
+		return;
+	}
+	SceneStreaming& stream = *streaming;
+	const StreamingConfig& settings = config->streaming;
+	auto start = std::chrono::steady_clock::now();
+	const glm::vec3 eye = renderer->getCameraTransform().translation;
+	const glm::ivec2 camera_cell = tile_of({ eye.x, eye.z });
+	auto distance = [&](glm::ivec2 cell) {
+		glm::ivec2 offset = glm::abs(cell - camera_cell);
+		return std::max(offset.x, offset.y);
+	};
+
+	if (stream.camera_cell != camera_cell) {
+		stream.camera_cell = camera_cell;
+		// cells leave loaded before unload_cell runs, so their meshes are not counted as still wanted
+		std::vector<SceneStreaming::CellState> unloaded;
+		for (auto it = stream.loaded.begin(); it != stream.loaded.end();) {
+			if (distance(it->first) > settings.unload_radius) {
+				unloaded.push_back(std::move(it->second));
+				it = stream.loaded.erase(it);
+			} else {
+				it++;
+			}
+		}
+		for (auto& cell : unloaded) {
+			unload_cell(stream, cell);
+		}
+		stream.queue.erase(std::remove_if(stream.queue.begin(), stream.queue.end(), [&](glm::ivec2 cell) { return stream.loaded.count(cell) == 0; }), stream.queue.end());
+		for (int x = -settings.load_radius; x <= settings.load_radius; x++) {
+			for (int y = -settings.load_radius; y <= settings.load_radius; y++) {
+				glm::ivec2 cell = camera_cell + glm::ivec2{ x, y };
+				if (stream.cells.count(cell) == 0 || !stream.loaded.try_emplace(cell).second) {
+					continue;
+				}
+				stream.queue.push_back(cell);
+#ifndef __EMSCRIPTEN__
+				SceneStreaming::CellState& state = stream.loaded[cell];
+				for (const auto& mesh : stream.cell_meshes[cell]) {
+					state.prefetched.push_back(translate_path("resources/meshes/") + mesh);
+				}
+				state.cancelled = std::make_shared<std::atomic<bool>>(false);
+				state.decoding = std::async(std::launch::async, [&renderer = *renderer, paths = state.prefetched, cancelled = state.cancelled]() {
+					for (const auto& path : paths) {
+						if (*cancelled) {
+							return;
+						}
+						if (file_exists(path)) {
+							renderer.prefetchModel(path);
+						}
+					}
+				});
+#endif
+			}
+		}
+		std::sort(stream.queue.begin(), stream.queue.end(), [&](glm::ivec2 a, glm::ivec2 b) { return distance(a) > distance(b); });
+	}
+	for (auto it = stream.discarding.begin(); it != stream.discarding.end();) {
+		if (it->decoding.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+			discard_cell_meshes(stream, it->paths);
+			it = stream.discarding.erase(it);
+		} else {
+			it++;
+		}
+	}
+
+	const auto budget = std::chrono::duration<float, std::milli>(config->scene_load_budget_ms);
+	while (!stream.queue.empty() && std::chrono::steady_clock::now() - start < budget) {
+		SceneStreaming::CellState& cell = stream.loaded[stream.queue.back()];
+		const std::vector<uint32_t>& records = stream.cells[stream.queue.back()];
+		if (cell.next_record == records.size()) {
+			stream.queue.pop_back();
+			continue;
+		}
+		uint32_t record = records[cell.next_record];
+		cell.next_record += 1;
+		if (stream.retired.count(record) != 0) {
+			continue;
+		}
+		ActorIndex index = actors.raw_add_actor(create_scene_actor(*stream.source, record));
+		cell.spawned.push_back({ record, index, actors.actors[index].actor->actor.id });
+		actors.start_actor(index);
+	}
+}
+
+// 0 to 1, reading and decoding meshes is the first half and creating actors the second; 1 when nothing is loading
+float World::scene_load_progress() const {
+	if (!scene_load) {
+		return 1.f;
+	}
+	const SceneLoad& load = *scene_load;
+	float read = 0.f;
+	if (load.read_done) {
+		read = load.mesh_count == 0 ? 1.f : static_cast<float>(load.meshes_decoded) / static_cast<float>(load.mesh_count);
+	}
+	float instantiated = 0.f;
+	if (load.instantiating) {
+		instantiated = load.actor_count == 0 ? 1.f : static_cast<float>(load.next_actor) / static_cast<float>(load.actor_count);
+	}
+	return 0.5f * read + 0.5f * instantiated;
+}
+
+// the name a component's method is reachable under, searching the component and the tables it inherits from
+static std::optional<std::string> method_name(const luabridge::LuaRef& component, const luabridge::LuaRef& function) {
+	lua_State* lua_state = component.state();
+	int top = lua_gettop(lua_state);
+	function.push();
+	component.push();
+	std::optional<std::string> name;
+	while (!name.has_value() && lua_istable(lua_state, -1)) {
+		lua_pushnil(lua_state);
+		while (lua_next(lua_state, -2) != 0) {
+			if (lua_type(lua_state, -2) == LUA_TSTRING && lua_rawequal(lua_state, -1, top + 1)) {
+				name = lua_tostring(lua_state, -2);
+				lua_pop(lua_state, 2);
+				break;
+			}
+			lua_pop(lua_state, 1);
+		}
+		if (!lua_getmetatable(lua_state, -1)) {
+			break;
+		}
+		lua_replace(lua_state, -2);
+	}
+	lua_settop(lua_state, top);
+	return name;
+}
+
+enum SnapshotActorFlags : uint8_t {
+	SnapshotActive = 1,
+	SnapshotDestroyOnLoad = 2,
+	SnapshotStarted = 4,
+};
+
+// Actors are written in update order with inactive ones last. Component fields follow all the actors so a restore can
+// resolve references to any of them, then event subscriptions that name a method of their component. Pending
+// AddComponent calls, running coroutines and subscriptions to other functions are not captured.
+// returns 0, with the message pushed, when a component holds something that cannot be saved
+uint32_t World::take_snapshot() {
+	WorldSnapshot snapshot;
+	snapshot.scene = current_scene;
+
+	std::vector<ActorIndex> live;
+	for (ActorIndex i = actors.head; i != numeric_max<ActorIndex>(); i = actors.actors[i].next) {
+		live.push_back(i);
+	}
+	for (ActorIndex i = 0; i < actors.actors.size(); i++) {
+		const auto& slot = actors.actors[i];
+		if (!slot.linked && slot.actor != nullptr && slot.actor->actor.id != numeric_max<ActorId>() && actors.to_destroy.count(i) == 0) {
+			live.push_back(i);
+		}
+	}
+
+	auto snapshot_components = [](const Actor& actor) {
+		std::vector<const Component*> components;
+		for (ComponentIndex i = 0; i < actor.components.size(); i++) {
+			if (!actor.components[i].lua_component.isNil() && std::find(actor.to_destroy.begin(), actor.to_destroy.end(), i) == actor.to_destroy.end()) {
+				components.push_back(&actor.components[i]);
+			}
+		}
+		return components;
+	};
+	auto pointer_of = [&](const luabridge::LuaRef& ref) {
+		ref.push();
+		const void* pointer = lua_topointer(lua_state, -1);
+		lua_pop(lua_state, 1);
+		return pointer;
+	};
+
+	std::unordered_map<ActorIndex, uint32_t> records;
+	std::unordered_map<const void*, SnapshotRef> component_records;
+	for (uint32_t record = 0; record < live.size(); record++) {
+		records.insert({ live[record], record });
+		for (const Component* component : snapshot_components(actors.actors[live[record]].actor->actor)) {
+			component_records.insert({ pointer_of(component->lua_component), { record, component->key } });
+		}
+	}
+
+	SnapshotWriter writer;
+	writer.find_reference = [&](lua_State* state, int index) -> std::optional<SnapshotRef> {
+		if (lua_type(state, index) == LUA_TUSERDATA && luabridge::Stack<LuaActor>::isInstance(state, index)) {
+			const LuaActor* lua_actor = luabridge::Stack<const LuaActor*>::get(state, index);
+			auto found = records.find(lua_actor->index);
+			if (found == records.end() || actors.actors[lua_actor->index].actor->actor.id != lua_actor->actor.id) {
+				return {};
+			}
+			return SnapshotRef{ found->second, "" };
+		}
+		auto found = component_records.find(lua_topointer(state, index));
+		if (found == component_records.end()) {
+			return {};
+		}
+		return found->second;
+	};
+
+	writer.transform(renderer->getCameraTransform());
+	writer.varint(live.size());
+	for (ActorIndex index : live) {
+		const Actor& actor = actors.actors[index].actor->actor;
+		writer.string(actor.name);
+		writer.byte(static_cast<uint8_t>((actor.active ? SnapshotActive : 0) | (actors.destroy_on_load.get(index) ? SnapshotDestroyOnLoad : 0)
+			| (actors.new_actors.count(index) == 0 ? SnapshotStarted : 0)));
+		std::vector<const Component*> components = snapshot_components(actor);
+		writer.varint(components.size());
+		for (const Component* component : components) {
+			writer.string(component->key);
+			writer.string(component->type);
+			writer.byte(component->enabled);
+			if (component->type == "Model") {
+				const Model* model = component->lua_component.cast<const Model*>();
+				writer.string(model->mesh);
+				writer.transform(model->transform);
+				writer.byte(model->is_static);
+				continue;
+			}
+			component->lua_component.push();
+			writer.metatable(lua_state, -1);
+			lua_pop(lua_state, 1);
+		}
+	}
+
+	for (ActorIndex index : live) {
+		const Actor& actor = actors.actors[index].actor->actor;
+		for (const Component* component : snapshot_components(actor)) {
+			if (component->type == "Model") {
+				continue;
+			}
+			component->lua_component.push();
+			writer.lua_fields(lua_state, -1, actor.name + "." + component->key, [](std::string_view name) { return name == "actor" || name == "key"; });
+			writer.byte(static_cast<uint8_t>(SnapshotTag::End));
+			lua_pop(lua_state, 1);
+			if (!writer.error.empty()) {
+				// raised by the caller, once nothing with a destructor is live
+				lua_pushfstring(lua_state, "Scene.Snapshot: %s, which cannot be saved", writer.error.c_str());
+				return 0;
+			}
+		}
+	}
+
+	struct Subscription {
+		std::string event_type;
+		SnapshotRef component;
+		std::string method;
+	};
+	std::vector<Subscription> subscriptions;
+	for (const auto& [event_type, handler] : events.subscriptions()) {
+		auto found = component_records.find(pointer_of(handler.component));
+		if (found == component_records.end()) {
+			continue;
+		}
+		std::optional<std::string> method = method_name(handler.component, handler.function);
+		if (method.has_value()) {
+			subscriptions.push_back({ event_type, found->second, std::move(method.value()) });
+		}
+	}
+	writer.varint(subscriptions.size());
+	for (const auto& subscription : subscriptions) {
+		writer.string(subscription.event_type);
+		writer.varint(subscription.component.record);
+		writer.string(subscription.component.key);
+		writer.string(subscription.method);
+	}
+
+	snapshot.data = writer.finish();
+	snapshot.metatables = std::move(writer.metatables);
+	uint32_t handle = next_snapshot;
+	next_snapshot += 1;
+	snapshots.insert({ handle, std::move(snapshot) });
+	return handle;
+}
+
+// replaces every actor, including ones marked DontDestroy, with the snapshot's; the snapshot's started actors do not
+// get OnStart again and their Models are spawned right away
+void World::restore_snapshot(const WorldSnapshot& snapshot) {
+	cancel_scene_load();
+	for (ActorIndex i = 0; i < actors.actors.size(); i++) {
+		const auto& slot = actors.actors[i];
+		if (slot.actor != nullptr && slot.actor->actor.id != numeric_max<ActorId>() && actors.to_destroy.count(i) == 0) {
+			actor_destroy(*slot.actor);
+		}
+	}
+	clear_scene();
+	// actors created this frame are gone too, so none of them may be started
+	actors.new_actors.clear();
+	actors.new_actor_list.clear();
+	current_scene = snapshot.scene;
+
+	SnapshotReader reader(snapshot.data, snapshot.metatables);
+	std::vector<ActorIndex> restored;
+	auto find_component = [&](const SnapshotRef& reference) -> const luabridge::LuaRef* {
+		const Actor& actor = actors.actors[restored[reference.record]].actor->actor;
+		auto found = actor.keys.find(reference.key);
+		return found == actor.keys.end() ? nullptr : &actor.components[found->second].lua_component;
+	};
+	reader.push_reference = [&](lua_State* state, const SnapshotRef& reference) {
+		if (reference.key.empty()) {
+			luabridge::Stack<LuaActor*>::push(state, actors.actors[restored[reference.record]].actor.get());
+		} else if (const luabridge::LuaRef* component = find_component(reference)) {
+			component->push();
+		} else {
+			lua_pushnil(state);
+		}
+	};
+
+	renderer->getCameraTransform() = reader.transform();
+	uint64_t actor_count = reader.varint();
+	std::vector<luabridge::LuaRef> tables;
+	for (uint64_t i = 0; i < actor_count; i++) {
+		Actor actor;
+		actor.name = reader.string();
+		uint8_t flags = reader.byte();
+		uint64_t component_count = reader.varint();
+		for (uint64_t j = 0; j < component_count; j++) {
+			std::string key{ reader.string() };
+			std::string type{ reader.string() };
+			bool enabled = reader.byte() != 0;
+			if (type == "Model") {
+				Model model(lua_state);
+				model.key = key;
+				model.mesh = reader.string();
+				model.transform = reader.transform();
+				model.is_static = reader.byte() != 0;
+				model.enabled = enabled;
+				actor.add_component({ { lua_state, std::move(model) }, key, std::move(type) });
+			} else {
+				uint64_t prototype = reader.varint();
+				luabridge::LuaRef component = make_instance(prototype == 0 ? luabridge::LuaRef(lua_state) : snapshot.metatables[prototype - 1]);
+				component["key"] = key;
+				tables.push_back(component);
+				actor.add_component({ component, key, std::move(type) });
+			}
+			actor.set_enabled(actor.keys[key], enabled);
+		}
+
+		bool started = (flags & SnapshotStarted) != 0;
+		ActorIndex index = started ? actors.raw_add_actor(std::move(actor)) : actors.add_actor(std::move(actor));
+		actors.destroy_on_load.set(index, (flags & SnapshotDestroyOnLoad) != 0);
+		if ((flags & SnapshotActive) == 0) {
+			actors.set_active(index, false);
+		}
+		if (started) {
+			for (auto& component : actors.actors[index].actor->actor.components) {
+				if (component.type == "Model") {
+					component.lua_component.cast<Model*>()->on_start(lua_state);
+				}
+			}
+		}
+		restored.push_back(index);
+	}
 
-	rapidjson::Document doc = ReadJsonFile(scene_path);
-	const auto& actor_list = doc["actors"];
-	ActorIndex first_index = numeric_max<ActorIndex>();
-	for (uint32_t i = 0; i < actor_list.Size(); i++) {
-		const auto& actor_data = actor_list[i];
-		ActorIndex new_index = actors.add_actor(templates.create_actor(actor_data));
-		if (first_index == numeric_max<ActorIndex>()) {
-			first_index = new_index;
+	for (const auto& table : tables) {
+		table.push();
+		reader.lua_fields(lua_state, -1);
+		lua_pop(lua_state, 1);
+	}
+
+	uint64_t subscription_count = reader.varint();
+	for (uint64_t i = 0; i < subscription_count; i++) {
+		std::string event_type{ reader.string() };
+		SnapshotRef reference{ static_cast<uint32_t>(reader.varint()), std::string{ reader.string() } };
+		std::string method{ reader.string() };
+		if (const luabridge::LuaRef* component = find_component(reference)) {
+			events.schedule_subscribe(event_type, *component, (*component)[method]);
 		}
 	}
 }
 
 bool World::run_turn() {
 	std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
-	if (next_scene.has_value()) {
+	if (next_restore.has_value()) {
+		auto found = snapshots.find(next_restore.value());
+		if (found != snapshots.end()) {
+			restore_snapshot(found->second);
+		} else {
+			std::cout << "error: no snapshot " << next_restore.value() << std::endl;
+			next_restore = {};
+		}
+	} else if (next_scene.has_value()) {
 		load_scene(next_scene.value());
+	} else if (next_async_scene.has_value()) {
+		load_scene_async(next_async_scene.value());
 	}
+	step_scene_load();
+	step_streaming();
 	bool ending = process_events();
 	update_actors();
 	events.apply_scheduled();
@@ -1506,7 +4465,11 @@ bool World::run_turn() {
 	std::chrono::duration<double> elapsed = end - start;
 	double frame_time = elapsed.count();
 	if (*frame_number % 60 == 0) {
-		std::cout << "Last frame time: " << frame_time << std::endl;
+		const CullStats& culling = renderer->getCullStats();
+		const RenderStats& stats = renderer->getRenderStats();
+		std::cout << "Last frame time: " << frame_time << " (" << culling.visible << " instances drawn, " << culling.culled << " culled, "
+			<< stats.draws << " draws, " << stats.binds << " state changes, " << stats.skipped << " skipped, "
+			<< stats.bundle_hits << "/" << stats.bundle_hits + stats.bundle_misses << " bundles replayed)" << std::endl;
 	}
 	return ending;
 }
@@ -5,6 +5,13 @@
 #include <bitset>
 #include <unordered_map>
 #include <unordered_set>
+#include <queue>
+#include <chrono>
+#include <functional>
+#include <deque>
+#include <future>
+#include <atomic>
+#include <thread>
 
 #include "glm/glm.hpp"
 #include "rapidjson/document.h"
@@ -18,6 +25,7 @@
 #include "SDL_mouse.h"
 
 #include "renderer.h"
+#include "cooked.h"
 
 constexpr float coord_size = 100.f;
 constexpr glm::ivec2 coord_tile_size = { 100, 100 };
@@ -78,14 +86,76 @@ public:
 	void set(size_t index, bool new_val);
 };
 
+enum class WatchdogPolicy {
+	Report,
+	Abort,
+	Disable,
+};
+
+// "watchdog" in game.config; a zero budget is unlimited
+struct WatchdogConfig {
+	bool enabled = false;
+	uint64_t call_instructions = 0;
+	double call_ms = 0.;
+	uint64_t frame_instructions = 0;
+	double frame_ms = 0.;
+	int check_interval = 1000;
+	WatchdogPolicy policy = WatchdogPolicy::Report;
+};
+
+// "streaming" in game.config; radii are in tiles of coord_tile_size, measured as the larger of the x and z distance
+struct StreamingConfig {
+	std::unordered_set<std::string> scenes;
+	int load_radius = 2;
+	int unload_radius = 3;
+};
+
 struct GameConfig {
 	std::string initial_scene;
 	std::string window_name;
 	std::optional<std::string> font;
+	WatchdogConfig watchdog;
+	StreamingConfig streaming;
+	// time Scene.LoadAsync may spend per frame instantiating and starting actors
+	float scene_load_budget_ms = 4.f;
+	// time the work scheduler may spend per frame starting new actors and components, uploading meshes and decoding audio
+	float work_budget_ms = 2.f;
+	// frames deferred work may wait before it runs regardless of the budget
+	uint32_t work_max_wait_frames = 30;
+	// memory a scene load may spend preloading its manifest; anything past it loads on first use
+	size_t preload_budget_mb = 512;
 
 	GameConfig();
 };
 
+// Budgets Lua callbacks from a count hook so a runaway script is reported (or cut short) instead of stalling the frame
+class ScriptWatchdog {
+	using Clock = std::chrono::steady_clock;
+
+	WatchdogConfig config;
+	int depth = 0;
+	bool overrun = false;
+	bool frame_overrun = false;
+	uint64_t call_instructions = 0;
+	uint64_t frame_instructions = 0;
+	Clock::time_point call_start;
+	Clock::duration frame_time{};
+	std::string actor_name;
+	std::string component_type;
+	std::string callback;
+
+	static void hook(lua_State* lua_state, lua_Debug* debug);
+	void check(lua_State* lua_state);
+public:
+	void install(lua_State* lua_state, const WatchdogConfig& watchdog_config);
+	static ScriptWatchdog* from(lua_State* lua_state);
+
+	void begin_frame();
+	void begin_call(std::string_view actor, std::string_view type, std::string_view callback_name);
+	// returns true if the call overran and the policy is to disable the component
+	bool end_call();
+};
+
 struct Ivec2Hasher {
 	std::size_t operator()(const glm::ivec2& vec) const noexcept;
 };
@@ -94,6 +164,9 @@ struct Component {
 	luabridge::LuaRef lua_component;
 	std::string key;
 	std::string type;
+	bool enabled = true;
+	// position in the collection's set of its type, max while not in one
+	uint32_t type_slot = numeric_max<uint32_t>();
 };
 
 struct Actor {
@@ -111,17 +184,47 @@ struct Actor {
 	std::vector<ComponentIndex> free_list;
 	ActorId id = numeric_max<ActorId>();
 	uint32_t needs_destroy = 0;
+	bool active = true;
 
 	void insert_sorted(std::vector<ComponentIndex>& v, ComponentIndex e);
 	void remove_sorted(std::vector<ComponentIndex>& v, ComponentIndex e);
+	void link_callbacks(ComponentIndex index);
+	void unlink_callbacks(ComponentIndex index);
 	Component& add_component(Component new_component);
 	void remove_component(std::string key, bool force = false);
+	void set_enabled(ComponentIndex index, bool enabled);
 	void call_destroy();
 
 	void clear();
 };
 
-static rapidjson::Document ReadJsonFile(const std::string& path);
+// A JSON file parsed in place: strings in the DOM point into the file's text and nodes come from a pooled arena,
+// so the DOM is only valid while the JsonFile is alive. Arenas (and their text buffers) are reused by later files
+// on the same thread; pass pooled = false for a file that will be destroyed on another thread.
+class JsonFile {
+	struct Arena {
+		static constexpr size_t pool_size = 256 * 1024;
+		std::vector<char> text;
+		std::unique_ptr<char[]> pool{ new char[pool_size] };
+		rapidjson::MemoryPoolAllocator<> allocator{ pool.get(), pool_size };
+	};
+
+	bool pooled;
+	std::unique_ptr<Arena> arena;
+	rapidjson::Document document;
+
+	static std::vector<std::unique_ptr<Arena>>& spare_arenas();
+	static std::unique_ptr<Arena> take_arena(bool pooled);
+public:
+	JsonFile(const std::string& path, bool pooled = true);
+	JsonFile(const JsonFile&) = delete;
+	JsonFile& operator=(const JsonFile&) = delete;
+	~JsonFile();
+
+	const rapidjson::Document& doc() const {
+		return document;
+	}
+};
 
 template<typename T>
 std::optional<T> get_value(const rapidjson::Value& val, const char* key);
@@ -136,6 +239,9 @@ luabridge::LuaRef get_value(lua_State* lua_state, const rapidjson::Value& val);
 
 void set_metatable(const luabridge::LuaRef& base, const luabridge::LuaRef& meta);
 
+// points the component instance at index to a metatable that reads back enabled as the engine's flag
+void set_instance_enabled(lua_State* lua_state, int index, bool enabled);
+
 template<typename T>
 void swap_remove(std::vector<T>& v, size_t index);
 
@@ -149,6 +255,9 @@ class AudioManager {
 public:
 	AudioManager();
 	Mix_Chunk* load_sound(const std::string& file_name);
+	// decodes a clip from bytes read elsewhere, returns nullptr if they are not audio
+	Mix_Chunk* load_sound(const std::string& file_name, std::span<const char> bytes);
+	bool is_loaded(const std::string& file_name) const;
 	int play_sound(Mix_Chunk* audio, int channel = -1, bool loops = false) const;
 	void stop_sound(int channel) const;
 	void set_volume(int channel, int volume) const;
@@ -163,33 +272,143 @@ struct Model {
 	bool transform_dirty = true;
 	bool enabled = true;
 	bool mesh_dirty = true;
+	// drawn from the model's static instance buffer; set before the first frame, changing it later respawns the instance
+	bool is_static = false;
 
 	Model(lua_State* lua_state) : actor(lua_state) {};
 
 	void on_start(lua_State* lua_state);
 	void on_update(lua_State* lua_state);
 	void on_destroy(lua_State* lua_state);
+	void write_transform(Renderer* renderer);
+
+	// Model.SetTransforms(models, transforms) and Model.SetTranslations(models, positions)
+	static int set_transforms(lua_State* lua_state);
+	static int set_translations(lua_State* lua_state);
 };
 
 struct Camera {
 	lua_State* lua_state;
 };
 
+// Everything a scene can use before its first frame: the templates its actors come from or its scripts instantiate by
+// name (string literals passed to Instantiate), their component types, Model meshes and audio clips, plus whatever the
+// scene lists under "preload". Missing files are left out, to be reported where they are used.
+struct SceneManifest {
+	struct Clip {
+		std::string name;
+		std::string path;
+	};
+	std::vector<std::string> templates;
+	std::vector<std::string> components;
+	std::vector<std::string> meshes; // paths
+	std::vector<Clip> audio;
+
+	// reads the scene (cooked or JSON, whichever the engine would load) itself; safe to call from any thread
+	static SceneManifest scan(const std::string& scene_name);
+	// one of the two is the scene, already open
+	static SceneManifest scan(const cooked::File* cooked_scene, const rapidjson::Value* json_scene);
+};
+
+// Startup: a worker pool builds the initial scene's manifest (templates, component types, meshes, audio clips) and reads
+// or decodes everything in it while the main thread creates the GPU device and loads the scene. Loaders on the main thread
+// take their file from here (waiting for it if it is still being read); join() hands decoded meshes to the renderer.
+class StartupPreloader {
+	using Clock = std::chrono::steady_clock;
+
+	struct Job {
+		enum class Kind {
+			File,
+			Component, // source and cached bytecode of a component type
+			Mesh,
+		};
+		Kind kind;
+		std::string path;
+	};
+
+	static StartupPreloader* current;
+
+	Clock::time_point start = Clock::now();
+	std::string scene_name;
+	std::vector<std::thread> workers;
+	std::vector<Job> jobs;
+	std::atomic<size_t> next_job = 0;
+
+	std::mutex mutex;
+	std::condition_variable progress;
+	bool scanned = false;
+	std::unordered_set<std::string> pending;
+	std::unordered_map<std::string, std::string> files;
+	std::unordered_map<std::string, tinygltf::Model> models;
+	std::vector<std::pair<double, std::string>> timeline;
+
+	void scan();
+	void run_job(const Job& job);
+	void work(bool scanner);
+public:
+	StartupPreloader(std::string scene_name);
+	StartupPreloader(const StartupPreloader&) = delete;
+	StartupPreloader& operator=(const StartupPreloader&) = delete;
+	~StartupPreloader();
+
+	// the preloaded contents of path, if it was part of the initial scene and nobody has taken it yet
+	static std::optional<std::string> take_file(const std::string& path);
+	static void mark(std::string event);
+	// waits for the workers, gives the renderer every decoded mesh, frees the files nobody took and prints the timeline
+	static void join(Renderer& renderer);
+};
+
 class TemplateManager {
+	// the fields of one scene or template component, read from JSON or from a cooked file
+	struct ComponentFields {
+		std::string id; // identifies the content, for sharing prototypes
+		int count = 0;
+		// pushes each value in order and passes its field name to the callback, which pops it
+		std::function<void(const std::function<void(const char*)>&)> for_each;
+	};
+
 	lua_State* lua_state;
 	std::unordered_map<std::string, Actor> templates;
 	std::unordered_map<std::string, luabridge::LuaRef> components;
+	// scene overrides converted once, keyed by parent and content so identical overrides share a table; cleared on scene
+	// change (instances keep theirs alive through their metatable)
+	std::unordered_map<std::string, luabridge::LuaRef> prototypes;
 	std::shared_ptr<Renderer> renderer;
 
 	luabridge::LuaRef make_template_component(std::string type);
+	// Instances share everything in a prototype, nested tables included: assigning a field gives the instance its own
+	// value, but writing into a table read from the prototype changes it for every instance built from the same overrides
+	luabridge::LuaRef make_prototype(const std::string& id, const luabridge::LuaRef& parent, const ComponentFields& overrides);
+	Component make_component(const Actor& templ, const std::string& template_name, std::string key, std::string type, const ComponentFields& overrides);
+	void add_template_component(Actor& templ, std::string key, std::string type, const ComponentFields& fields);
+	ComponentFields json_fields(const rapidjson::Value* component) const;
+	ComponentFields cooked_fields(const cooked::File& file, cooked::Section fields) const;
 	void load_component(std::string type);
 	void load_template(std::string name);
+	bool load_component_chunk(const std::string& type);
 public:
+	// where a scene actor stands on the ground plane (x and z of its first Model) and the meshes it uses, without creating it;
+	// actors without a Model have no position
+	struct Placement {
+		std::optional<glm::vec2> position;
+		std::vector<std::string> meshes;
+	};
+
 	TemplateManager(std::shared_ptr<Renderer> renderer, lua_State* lua_state);
 
+	// compiles every resources/component_types/*.lua to a .luac next to it, returns the number of failures
+	static int precompile_components(lua_State* lua_state);
+
 	Actor create_actor(const rapidjson::Value& actor);
+	Actor create_actor(const cooked::File& file, uint32_t index);
+	Placement placement(const rapidjson::Value& actor);
+	Placement placement(const cooked::File& file, uint32_t index);
 	Actor create_template_actor(std::string template_name);
 	luabridge::LuaRef create_component(std::string type, std::string key);
+	// load ahead of first use; nothing happens if already loaded
+	void preload_template(const std::string& name);
+	void preload_component(const std::string& type);
+	void clear_prototypes();
 };
 
 struct AddComponentQueue {
@@ -251,6 +470,224 @@ public:
 	void schedule_subscribe(std::string event_type, luabridge::LuaRef component, luabridge::LuaRef function);
 	void schedule_unsubscribe(std::string event_type, luabridge::LuaRef component, luabridge::LuaRef function);
 	void apply_scheduled();
+	// every handler, including ones scheduled this frame, with its event type
+	std::vector<std::pair<std::string, Handler>> subscriptions() const;
+};
+
+struct WaitCondition {
+	enum class Kind {
+		Frames,
+		Seconds,
+		Event,
+	};
+
+	Kind kind = Kind::Frames;
+	uint64_t frames = 1;
+	double seconds = 0.;
+	std::string event;
+};
+
+class CoroutineScheduler {
+public:
+	using Id = uint32_t;
+
+	struct Coroutine {
+		luabridge::LuaRef thread;
+		luabridge::LuaRef component;
+		ActorIndex actor;
+		ActorId actor_id;
+		// what the suspended coroutine is queued on, so stopping it can drop the entry
+		std::optional<WaitCondition::Kind> waiting;
+		std::string event;
+	};
+
+private:
+	struct Wake {
+		double at;
+		Id id;
+
+		bool operator>(const Wake& other) const {
+			return at > other.at;
+		}
+	};
+	using WakeQueue = std::priority_queue<Wake, std::vector<Wake>, std::greater<Wake>>;
+
+	std::unordered_map<Id, Coroutine> coroutines;
+	WakeQueue frame_queue;
+	WakeQueue time_queue;
+	std::unordered_map<std::string, std::vector<Id>> event_waiters;
+	std::vector<Id> ready;
+	// frame_queue and time_queue entries of coroutines that were stopped while waiting
+	size_t stale_wakes = 0;
+	Id next_id = 1;
+	uint64_t frame = 0;
+	double time = 0.;
+
+	void resume(lua_State* from, Id id, std::string_view actor_name, int nargs);
+	void forget(std::unordered_map<Id, Coroutine>::iterator it);
+	void compact_queues();
+public:
+	Id start(lua_State* from, Coroutine coroutine, luabridge::LuaRef function, std::string_view actor_name);
+	void stop(Id id);
+	void notify_event(const std::string& event_type);
+
+	void advance(uint64_t new_frame, double new_time);
+	// resumes every coroutine whose wake condition has fired; name_of returns the owning actor's name or nullptr if it is gone
+	template<class NameOf>
+	void resume_due(lua_State* from, NameOf name_of);
+	template<class NameOf>
+	void purge(NameOf name_of);
+};
+
+// Spreads bursty engine work (OnStart of new actors and components, mesh uploads, audio decoding) over frames. drain()
+// runs due work first: urgent tasks, tasks at their deadline and tasks that waited max_wait_frames. Then it runs the
+// rest by priority, oldest first, until the budget is spent, running at least one task every frame.
+class WorkScheduler {
+public:
+	enum class Priority : uint8_t {
+		High,
+		Normal,
+		Low,
+	};
+
+	struct Task {
+		std::function<void()> run;
+		Priority priority = Priority::Normal;
+		// the frame by which the task must have run
+		std::optional<uint64_t> deadline;
+		// the actor the task belongs to, for Work.Expedite
+		std::optional<ActorId> owner;
+		// at most one task per non-empty key is pending
+		std::string key;
+	};
+
+private:
+	struct Pending {
+		Task task;
+		uint64_t enqueued;
+	};
+
+	using Sequence = uint64_t;
+
+	float budget_ms;
+	uint64_t max_wait_frames;
+	// queues hold sequence numbers; a task that already ran is gone from here and skipped when it comes up
+	std::unordered_map<Sequence, Pending> tasks;
+	// the pending task holding each key
+	std::unordered_map<std::string, Sequence> keys;
+	std::array<std::deque<Sequence>, 3> queues;
+	std::deque<Sequence> urgent;
+	std::priority_queue<std::pair<uint64_t, Sequence>, std::vector<std::pair<uint64_t, Sequence>>, std::greater<>> deadlines;
+	Sequence next_sequence = 0;
+	uint64_t frame = 0;
+	bool flush = false;
+
+	bool run(Sequence sequence);
+public:
+	WorkScheduler(float budget_ms, uint64_t max_wait_frames) : budget_ms(budget_ms), max_wait_frames(max_wait_frames) {}
+
+	// returns false if a task with the same key is already pending
+	bool enqueue(Task task);
+	// drops the pending task with the key without running it
+	void cancel(const std::string& key);
+	bool pending(const std::string& key) const;
+	size_t pending_count() const;
+	// the next drain runs the owner's tasks (or the task with the key, or everything) regardless of the budget
+	void expedite(ActorId owner);
+	void expedite(const std::string& key);
+	void expedite_all();
+
+	void drain(uint64_t current_frame);
+};
+
+// Scene.Snapshot: every live actor with its components' Lua fields, Model state and destroy_on_load bit, packed into a
+// binary blob that Scene.Restore rebuilds the world from without reading JSON or calling OnStart. Metatables, both the
+// ones component instances inherit from (component types, template components and scene overrides) and the classes of
+// nested Lua objects, are kept by reference instead of being copied into the blob.
+struct WorldSnapshot {
+	std::string scene;
+	std::string data;
+	std::vector<luabridge::LuaRef> metatables;
+};
+
+enum class SnapshotTag : uint8_t {
+	Nil,
+	False,
+	True,
+	Integer,
+	Number,
+	String,
+	Table,
+	TableRef,
+	Vec2,
+	Vec3,
+	Transform,
+	Actor,
+	Component,
+	End,
+};
+
+// an actor in the snapshot (by record) or, with a key, one of its components
+struct SnapshotRef {
+	uint32_t record;
+	std::string key;
+};
+
+// Strings are interned into a table written ahead of the data, and a table reached twice (shared or cyclic) is
+// written once and referenced after that
+class SnapshotWriter {
+	std::string data;
+	std::string strings;
+	uint32_t string_count = 0;
+	std::unordered_map<std::string, uint32_t> interned;
+	std::unordered_map<const void*, uint32_t> tables;
+	std::unordered_map<const void*, uint32_t> metatable_indices;
+	// the keys leading to the field being written, for error messages
+	std::string path;
+
+	bool storable(lua_State* lua_state, int index) const;
+public:
+	// actors and components are written as references to their records rather than by value
+	std::function<std::optional<SnapshotRef>(lua_State*, int)> find_reference;
+	// every metatable written, indexed by what metatable() wrote minus one
+	std::vector<luabridge::LuaRef> metatables;
+	// set to a description of the first field that could not be stored; what was written after that is meaningless
+	std::string error;
+
+	void byte(uint8_t value);
+	void varint(uint64_t value);
+	void floats(const float* values, size_t count);
+	void string(std::string_view value);
+	void transform(const Transform& value);
+	// the index of the metatable of the value at index plus one, or 0 when it has none
+	void metatable(lua_State* lua_state, int index);
+	// writes nothing and returns false for values that cannot be stored: functions, threads and unknown userdata
+	bool lua_value(lua_State* lua_state, int index);
+	// the raw fields of the table at index as key, value pairs; the caller ends them with SnapshotTag::End. A field
+	// that cannot be stored sets error, naming it after name.
+	void lua_fields(lua_State* lua_state, int index, std::string_view name, const std::function<bool(std::string_view)>& skip = {});
+	std::string finish() const;
+};
+
+class SnapshotReader {
+	std::string_view data;
+	size_t position = 0;
+	std::vector<std::string_view> strings;
+	std::vector<luabridge::LuaRef> tables;
+	const std::vector<luabridge::LuaRef>& metatables;
+public:
+	std::function<void(lua_State*, const SnapshotRef&)> push_reference;
+
+	SnapshotReader(std::string_view blob, const std::vector<luabridge::LuaRef>& metatables);
+	uint8_t byte();
+	uint64_t varint();
+	void floats(float* values, size_t count);
+	std::string_view string();
+	Transform transform();
+	// pushes the next value
+	void lua_value(lua_State* lua_state);
+	// sets the fields written by SnapshotWriter::lua_fields on the table at index
+	void lua_fields(lua_State* lua_state, int index);
 };
 
 class World {
@@ -267,6 +704,7 @@ class World {
 			std::unique_ptr<LuaActor> actor;
 			ActorIndex next;
 			ActorIndex prev;
+			bool linked = false;
 		};
 
 		std::vector<ActorSlot> actors;
@@ -274,25 +712,57 @@ class World {
 		ActorIndex tail = numeric_max<ActorIndex>();
 		BitVec destroy_on_load;
 		std::unordered_map<std::string, std::vector<ActorIndex>> names;
+		// every live component of each type, in the order they were added; removals leave a hole (actor == max)
+		// until the sets are compacted at the next frame boundary
+		struct TypeEntry {
+			ActorIndex actor;
+			ComponentIndex component;
+		};
+		struct TypeSet {
+			std::vector<TypeEntry> entries;
+			uint32_t holes = 0;
+			// bumped by every compaction, so iterators can tell their position is stale
+			uint32_t generation = 0;
+		};
+		std::unordered_map<std::string, TypeSet> type_sets;
 		AddComponentQueue component_queue;
 		std::unordered_set<ActorIndex> new_actors;
 		std::vector<ActorIndex> new_actor_list;
 		std::vector<ActorIndex> freed_list;
 		std::unordered_set<ActorIndex> to_destroy;
+		// inactive actors are unlinked from the update list until the next frame boundary after SetActive(true)
+		std::vector<std::pair<ActorIndex, ActorId>> to_activate;
+		std::vector<std::pair<ActorIndex, ActorId>> inactive_destroy;
 		ActorId next_id = 0;
 
 		ActorIndex curr_actor = numeric_max<ActorIndex>();
 		bool curr_actor_destroyed = false;
 
 		void apply_queue();
+		const std::string* coroutine_owner(const CoroutineScheduler::Coroutine& coroutine) const;
 		ActorIndex add_actor(Actor actor);
 		ActorIndex raw_add_actor(Actor actor);
+		void link(ActorIndex index);
+		void unlink(ActorIndex index);
+		void set_active(ActorIndex index, bool active);
+		void apply_activations();
 
 		luabridge::LuaRef find(const char* name, lua_State* lua_state);
 		luabridge::LuaRef find_all(const char* name, lua_State* lua_state);
 
+		void index_component(ActorIndex index, ComponentIndex component);
+		void unindex_component(ActorIndex index, ComponentIndex component);
+		void unindex_actor(ActorIndex index);
+		void compact_type_sets();
+		// Actor.FindAllWithComponent, Actor.EachWithComponent and Actor.FindAllWithComponents
+		luabridge::LuaRef find_all_with_component(const std::string& type, lua_State* lua_state);
+		luabridge::LuaRef each_with_component(const std::string& type, lua_State* lua_state);
+		luabridge::LuaRef find_all_with_components(luabridge::LuaRef types, lua_State* lua_state);
+		static int next_with_component(lua_State* lua_state);
+
 		void call_actor_start(ActorIndex from = numeric_max<ActorIndex>());
 		void call_new_actor_start();
+		void start_actor(ActorIndex index);
 		void call_actor_update();
 		void call_actor_late_update();
 		void call_actor_destroy();
@@ -300,7 +770,9 @@ class World {
 		luabridge::LuaRef instantiate(const char* template_name, lua_State* lua_state);
 		void dont_destroy_on_load(ActorIndex index);
 
-		ActorCollection(TemplateManager& templates) : component_queue(AddComponentQueue{ 0, {}, templates }) {};
+		WorkScheduler& work;
+
+		ActorCollection(TemplateManager& templates, WorkScheduler& work) : component_queue(AddComponentQueue{ 0, {}, templates }), work(work) {};
 	};
 
 	struct LuaActor {
@@ -316,8 +788,13 @@ class World {
 
 		luabridge::LuaRef add_component(const char* type, lua_State* lua_state);
 		void remove_component(luabridge::LuaRef component_ref);
+		void set_enabled(luabridge::LuaRef component_ref, bool enabled);
+		void set_enabled_by_key(const std::string& key, bool enabled);
+		bool is_enabled(luabridge::LuaRef component_ref) const;
+		void set_active(bool active);
+		bool is_active() const;
 
-		void call_component_method(luabridge::LuaRef component, std::string_view name);
+		void call_component_method(const Component& component, std::string_view name);
 	};
 
 	std::shared_ptr<GameConfig> config;
@@ -327,19 +804,107 @@ class World {
 	glm::vec2 camera_pos = { 0.f, 0.f };
 	std::string current_scene;
 	std::optional<std::string> next_scene;
+	std::optional<std::string> next_async_scene;
+	std::optional<uint32_t> next_restore;
+	std::unordered_map<uint32_t, WorldSnapshot> snapshots;
+	uint32_t next_snapshot = 1;
 
 	AudioManager audio_manager;
 	TemplateManager templates;
 	InputManager inputs;
+	WorkScheduler work;
 
 	ActorCollection actors;
 
 	lua_State* lua_state;
 
 	EventBus events;
+	CoroutineScheduler coroutines;
+	ScriptWatchdog watchdog;
+
+	// Scene.LoadAsync: a worker reads the scene, builds its manifest, decodes the meshes and reads the audio clips in it;
+	// then the manifest is loaded and actors are created a few per frame
+	struct SceneLoad {
+		std::string name;
+		std::string path;
+		bool use_cooked = false;
+		bool streamed = false;
+		bool preload = true;
+		cooked::File cooked_scene;
+		std::unique_ptr<JsonFile> json;
+		uint32_t actor_count = 0;
+		uint32_t next_actor = 0;
+		bool instantiating = false;
+		SceneManifest manifest;
+		// set by the workers for each mesh, then each clip, they got to before the budget ran out
+		std::vector<uint8_t> prepared;
+		std::vector<std::string> clip_bytes;
+		size_t next_preload = 0;
+		size_t budget_bytes = 0;
+		std::atomic<size_t> preloaded_bytes = 0;
+		uint32_t skipped = 0;
+		std::atomic<bool> read_done = false;
+		std::atomic<bool> cancelled = false;
+		std::atomic<uint32_t> mesh_count = 0;
+		std::atomic<uint32_t> meshes_decoded = 0;
+		// last, so it is destroyed (waiting for the worker) before anything the worker uses
+		std::future<void> worker;
+	};
+	std::unique_ptr<SceneLoad> scene_load;
+
+	// a streamed scene keeps only the grid cells near the camera instantiated; actors without a Model are always resident
+	struct SceneStreaming {
+		struct Spawned {
+			uint32_t record;
+			ActorIndex index;
+			ActorId id;
+		};
+		struct CellState {
+			size_t next_record = 0;
+			std::vector<Spawned> spawned;
+			// mesh paths handed to the decoder when the cell came into range; whatever nothing uploaded is discarded once
+			// the cell is unloaded, so sweeping the camera across a scene does not leave its geometry decoded
+			std::vector<std::string> prefetched;
+			std::future<void> decoding;
+			std::shared_ptr<std::atomic<bool>> cancelled;
+		};
+		// an unloaded cell whose meshes were still decoding; discarded once the decode is done
+		struct PendingDiscard {
+			std::future<void> decoding;
+			std::vector<std::string> paths;
+		};
+		std::unique_ptr<SceneLoad> source;
+		std::unordered_map<glm::ivec2, std::vector<uint32_t>, Ivec2Hasher> cells;
+		std::unordered_map<glm::ivec2, std::vector<std::string>, Ivec2Hasher> cell_meshes;
+		std::unordered_map<glm::ivec2, CellState, Ivec2Hasher> loaded;
+		// cells still being instantiated, nearest last
+		std::vector<glm::ivec2> queue;
+		// records whose actor was destroyed by a script or wandered out of its cell; never spawned again
+		std::unordered_set<uint32_t> retired;
+		std::optional<glm::ivec2> camera_cell;
+		std::vector<PendingDiscard> discarding;
+	};
+	std::unique_ptr<SceneStreaming> streaming;
+
+	static void read_scene(SceneLoad& load, Renderer& renderer);
+	bool preload_next(SceneLoad& load);
+	void report_preload(const SceneLoad& load) const;
+	std::unique_ptr<SceneLoad> open_scene(const std::string& scene_name) const;
+	Actor create_scene_actor(const SceneLoad& load, uint32_t record);
+	void cancel_scene_load();
+	void step_scene_load();
+	void publish_scene_loaded(const std::string& scene_name);
+	float scene_load_progress() const;
+	void start_streaming(std::unique_ptr<SceneLoad> source);
+	void step_streaming();
+	void unload_cell(SceneStreaming& stream, SceneStreaming::CellState& cell);
+	void discard_cell_meshes(SceneStreaming& stream, const std::vector<std::string>& paths);
+	void stop_streaming();
 
 	void clear_scene();
 	void update_actors();
+	uint32_t take_snapshot();
+	void restore_snapshot(const WorldSnapshot& snapshot);
 
 	// returns true if the game should end
 	bool process_events();
@@ -349,7 +914,9 @@ class World {
 	World(std::shared_ptr<GameConfig> game_config, std::shared_ptr<Renderer> renderer, lua_State* lua_state);
 public:
 	World(std::shared_ptr<GameConfig> game_config, lua_State* lua_state);
-	void load_scene(std::string scene_name);
+	// the initial scene is loaded without preloading, the startup preloader has done that already
+	void load_scene(std::string scene_name, bool preload = true);
+	void load_scene_async(std::string scene_name);
 
 	// returns true if the game should end
 	bool run_turn();
@@ -0,0 +1,450 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include "glm/glm.hpp"
+
+// Batched Transform -> model matrix conversion for instance buffers, and frustum culling of instance bounding spheres.
+// Inputs are gathered into structure of arrays streams and processed a SIMD register at a time; sin and cos are the
+// Cephes polynomials (as in sse_mathfun), which agree with the C library to a few ulp. The matrices are the ones
+// Transform::toMatrix builds: translate(translation) * yawPitchRoll(-rotation.x, rotation.z, rotation.y) * scale(scale).
+// x86-64 picks SSE2 or AVX2 at runtime; arm64 uses NEON and web builds WebAssembly SIMD when compiled with -msimd128.
+#if defined(__x86_64__) || defined(_M_X64)
+#define TRANSFORM_KERNEL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define TRANSFORM_KERNEL_NEON
+#include <arm_neon.h>
+#elif defined(__wasm_simd128__)
+#define TRANSFORM_KERNEL_WASM
+#include <wasm_simd128.h>
+#endif
+
+#ifdef _MSC_VER
+#define TRANSFORM_KERNEL_INLINE __forceinline
+#define TRANSFORM_KERNEL_AVX2
+#define TRANSFORM_KERNEL_AVX2_ENTRY
+#else
+#define TRANSFORM_KERNEL_INLINE inline __attribute__((always_inline))
+#define TRANSFORM_KERNEL_AVX2 __attribute__((target("avx2")))
+// always_inline would refuse to pull avx2 operations into the generic templates, so the entry point flattens instead
+#define TRANSFORM_KERNEL_AVX2_ENTRY __attribute__((target("avx2"), flatten))
+#endif
+
+#if defined(__GNUC__) && !defined(__clang__)
+// convert<Avx2> passes ymm values around before it is flattened into kernel_avx2; that ABI note never applies here
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+namespace transform_kernel {
+
+constexpr size_t batch_size = 64;
+
+enum Stream {
+	TranslationX, TranslationY, TranslationZ,
+	RotationX, RotationY, RotationZ,
+	ScaleX, ScaleY, ScaleZ,
+	StreamCount,
+};
+
+struct Streams {
+	alignas(32) float values[StreamCount][batch_size];
+};
+
+// converts the first count (at most batch_size) instances of in, writing instance i to *out[i]
+using Kernel = void (*)(const Streams& in, size_t count, glm::mat4* const* out);
+
+// World space bounding spheres for frustum culling
+enum SphereStream {
+	CenterX, CenterY, CenterZ, Radius,
+	SphereStreamCount,
+};
+
+struct Spheres {
+	alignas(32) float values[SphereStreamCount][batch_size];
+};
+
+struct Frustum {
+	// inward facing and normalised, so a sphere is outside when its centre is further than its radius behind one
+	glm::vec4 planes[6];
+	// the row of projection * view that gives clip space w, i.e. view depth
+	glm::vec4 depth;
+	// a sphere is culled as too small when radius * pixel_scale / depth < min_pixels; min_pixels 0 turns that off
+	float pixel_scale;
+	float min_pixels;
+};
+
+// returns a mask of the first count (at most batch_size) spheres that are visible
+using CullKernel = uint64_t (*)(const Spheres& in, size_t count, const Frustum& frustum);
+
+// the twelve matrix entries that are not constant, in column-major order of their columns 0..3, rows 0..2
+struct Columns {
+	float values[12];
+};
+
+inline void store_columns(const float (*entries)[batch_size], size_t first, size_t count, glm::mat4* const* out) {
+	for (size_t i = first; i < first + count; i++) {
+		glm::mat4& m = *out[i];
+		for (int column = 0; column < 4; column++) {
+			for (int row = 0; row < 3; row++) {
+				m[column][row] = entries[column * 3 + row][i];
+			}
+			m[column][3] = column == 3 ? 1.f : 0.f;
+		}
+	}
+}
+
+// the reference: the same expressions as glm::yawPitchRoll and the translate * rotate * scale product, with libm sin/cos
+inline void convert_scalar(const Streams& in, size_t first, size_t count, glm::mat4* const* out) {
+	for (size_t i = first; i < first + count; i++) {
+		const auto& v = in.values;
+		float ch = std::cos(-v[RotationX][i]);
+		float sh = std::sin(-v[RotationX][i]);
+		float cp = std::cos(v[RotationZ][i]);
+		float sp = std::sin(v[RotationZ][i]);
+		float cb = std::cos(v[RotationY][i]);
+		float sb = std::sin(v[RotationY][i]);
+		float sx = v[ScaleX][i];
+		float sy = v[ScaleY][i];
+		float sz = v[ScaleZ][i];
+		glm::mat4& m = *out[i];
+		m[0] = glm::vec4((ch * cb + sh * sp * sb) * sx, (sb * cp) * sx, (-sh * cb + ch * sp * sb) * sx, 0.f);
+		m[1] = glm::vec4((-ch * sb + sh * sp * cb) * sy, (cb * cp) * sy, (sb * sh + ch * sp * cb) * sy, 0.f);
+		m[2] = glm::vec4((sh * cp) * sz, (-sp) * sz, (ch * cp) * sz, 0.f);
+		m[3] = glm::vec4(v[TranslationX][i], v[TranslationY][i], v[TranslationZ][i], 1.f);
+	}
+}
+
+inline void kernel_scalar(const Streams& in, size_t count, glm::mat4* const* out) {
+	convert_scalar(in, 0, count, out);
+}
+
+inline uint64_t cull_scalar(const Spheres& in, size_t first, size_t count, const Frustum& frustum) {
+	uint64_t visible = 0;
+	for (size_t i = first; i < first + count; i++) {
+		glm::vec4 center(in.values[CenterX][i], in.values[CenterY][i], in.values[CenterZ][i], 1.f);
+		float radius = in.values[Radius][i];
+		bool inside = radius * frustum.pixel_scale >= glm::dot(frustum.depth, center) * frustum.min_pixels;
+		for (int plane = 0; plane < 6 && inside; plane++) {
+			inside = glm::dot(frustum.planes[plane], center) >= -radius;
+		}
+		visible |= static_cast<uint64_t>(inside) << i;
+	}
+	return visible;
+}
+
+inline uint64_t cull_kernel_scalar(const Spheres& in, size_t count, const Frustum& frustum) {
+	return cull_scalar(in, 0, count, frustum);
+}
+
+// Cephes range reduction loses precision past this; such lanes go through the scalar path
+constexpr float max_angle = 8192.f;
+
+// Each ISA provides F (float lanes), I (int32 lanes) and the operations below; convert<S> is written once against them.
+#ifdef TRANSFORM_KERNEL_X86
+struct Sse2 {
+	static constexpr size_t width = 4;
+	using F = __m128;
+	using I = __m128i;
+	static TRANSFORM_KERNEL_INLINE F load(const float* p) { return _mm_load_ps(p); }
+	static TRANSFORM_KERNEL_INLINE void store(float* p, F a) { _mm_store_ps(p, a); }
+	static TRANSFORM_KERNEL_INLINE F set(float a) { return _mm_set1_ps(a); }
+	static TRANSFORM_KERNEL_INLINE I iset(int32_t a) { return _mm_set1_epi32(a); }
+	static TRANSFORM_KERNEL_INLINE F add(F a, F b) { return _mm_add_ps(a, b); }
+	static TRANSFORM_KERNEL_INLINE F sub(F a, F b) { return _mm_sub_ps(a, b); }
+	static TRANSFORM_KERNEL_INLINE F mul(F a, F b) { return _mm_mul_ps(a, b); }
+	static TRANSFORM_KERNEL_INLINE F bit_and(F a, F b) { return _mm_and_ps(a, b); }
+	static TRANSFORM_KERNEL_INLINE F bit_andnot(F a, F b) { return _mm_andnot_ps(a, b); }
+	static TRANSFORM_KERNEL_INLINE F bit_xor(F a, F b) { return _mm_xor_ps(a, b); }
+	static TRANSFORM_KERNEL_INLINE I truncate(F a) { return _mm_cvttps_epi32(a); }
+	static TRANSFORM_KERNEL_INLINE F to_float(I a) { return _mm_cvtepi32_ps(a); }
+	static TRANSFORM_KERNEL_INLINE F as_float(I a) { return _mm_castsi128_ps(a); }
+	static TRANSFORM_KERNEL_INLINE I iadd(I a, I b) { return _mm_add_epi32(a, b); }
+	static TRANSFORM_KERNEL_INLINE I isub(I a, I b) { return _mm_sub_epi32(a, b); }
+	static TRANSFORM_KERNEL_INLINE I iand(I a, I b) { return _mm_and_si128(a, b); }
+	static TRANSFORM_KERNEL_INLINE I iandnot(I a, I b) { return _mm_andnot_si128(a, b); }
+	static TRANSFORM_KERNEL_INLINE I shift_to_sign(I a) { return _mm_slli_epi32(a, 29); }
+	static TRANSFORM_KERNEL_INLINE I iequal(I a, I b) { return _mm_cmpeq_epi32(a, b); }
+	static TRANSFORM_KERNEL_INLINE bool any_greater(F a, F b) { return _mm_movemask_ps(_mm_cmpgt_ps(a, b)) != 0; }
+	static TRANSFORM_KERNEL_INLINE uint32_t less_mask(F a, F b) { return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(a, b))); }
+};
+
+struct Avx2 {
+	static constexpr size_t width = 8;
+	using F = __m256;
+	using I = __m256i;
+	static TRANSFORM_KERNEL_AVX2 inline F load(const float* p) { return _mm256_load_ps(p); }
+	static TRANSFORM_KERNEL_AVX2 inline void store(float* p, F a) { _mm256_store_ps(p, a); }
+	static TRANSFORM_KERNEL_AVX2 inline F set(float a) { return _mm256_set1_ps(a); }
+	static TRANSFORM_KERNEL_AVX2 inline I iset(int32_t a) { return _mm256_set1_epi32(a); }
+	static TRANSFORM_KERNEL_AVX2 inline F add(F a, F b) { return _mm256_add_ps(a, b); }
+	static TRANSFORM_KERNEL_AVX2 inline F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+	static TRANSFORM_KERNEL_AVX2 inline F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+	static TRANSFORM_KERNEL_AVX2 inline F bit_and(F a, F b) { return _mm256_and_ps(a, b); }
+	static TRANSFORM_KERNEL_AVX2 inline F bit_andnot(F a, F b) { return _mm256_andnot_ps(a, b); }
+	static TRANSFORM_KERNEL_AVX2 inline F bit_xor(F a, F b) { return _mm256_xor_ps(a, b); }
+	static TRANSFORM_KERNEL_AVX2 inline I truncate(F a) { return _mm256_cvttps_epi32(a); }
+	static TRANSFORM_KERNEL_AVX2 inline F to_float(I a) { return _mm256_cvtepi32_ps(a); }
+	static TRANSFORM_KERNEL_AVX2 inline F as_float(I a) { return _mm256_castsi256_ps(a); }
+	static TRANSFORM_KERNEL_AVX2 inline I iadd(I a, I b) { return _mm256_add_epi32(a, b); }
+	static TRANSFORM_KERNEL_AVX2 inline I isub(I a, I b) { return _mm256_sub_epi32(a, b); }
+	static TRANSFORM_KERNEL_AVX2 inline I iand(I a, I b) { return _mm256_and_si256(a, b); }
+	static TRANSFORM_KERNEL_AVX2 inline I iandnot(I a, I b) { return _mm256_andnot_si256(a, b); }
+	static TRANSFORM_KERNEL_AVX2 inline I shift_to_sign(I a) { return _mm256_slli_epi32(a, 29); }
+	static TRANSFORM_KERNEL_AVX2 inline I iequal(I a, I b) { return _mm256_cmpeq_epi32(a, b); }
+	static TRANSFORM_KERNEL_AVX2 inline bool any_greater(F a, F b) { return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GT_OQ)) != 0; }
+	static TRANSFORM_KERNEL_AVX2 inline uint32_t less_mask(F a, F b) { return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ))); }
+};
+#endif
+
+#ifdef TRANSFORM_KERNEL_NEON
+struct Neon {
+	static constexpr size_t width = 4;
+	using F = float32x4_t;
+	using I = int32x4_t;
+	static TRANSFORM_KERNEL_INLINE F load(const float* p) { return vld1q_f32(p); }
+	static TRANSFORM_KERNEL_INLINE void store(float* p, F a) { vst1q_f32(p, a); }
+	static TRANSFORM_KERNEL_INLINE F set(float a) { return vdupq_n_f32(a); }
+	static TRANSFORM_KERNEL_INLINE I iset(int32_t a) { return vdupq_n_s32(a); }
+	static TRANSFORM_KERNEL_INLINE F add(F a, F b) { return vaddq_f32(a, b); }
+	static TRANSFORM_KERNEL_INLINE F sub(F a, F b) { return vsubq_f32(a, b); }
+	static TRANSFORM_KERNEL_INLINE F mul(F a, F b) { return vmulq_f32(a, b); }
+	static TRANSFORM_KERNEL_INLINE F bit_and(F a, F b) { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+	static TRANSFORM_KERNEL_INLINE F bit_andnot(F a, F b) { return vreinterpretq_f32_u32(vbicq_u32(vreinterpretq_u32_f32(b), vreinterpretq_u32_f32(a))); }
+	static TRANSFORM_KERNEL_INLINE F bit_xor(F a, F b) { return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+	static TRANSFORM_KERNEL_INLINE I truncate(F a) { return vcvtq_s32_f32(a); }
+	static TRANSFORM_KERNEL_INLINE F to_float(I a) { return vcvtq_f32_s32(a); }
+	static TRANSFORM_KERNEL_INLINE F as_float(I a) { return vreinterpretq_f32_s32(a); }
+	static TRANSFORM_KERNEL_INLINE I iadd(I a, I b) { return vaddq_s32(a, b); }
+	static TRANSFORM_KERNEL_INLINE I isub(I a, I b) { return vsubq_s32(a, b); }
+	static TRANSFORM_KERNEL_INLINE I iand(I a, I b) { return vandq_s32(a, b); }
+	static TRANSFORM_KERNEL_INLINE I iandnot(I a, I b) { return vbicq_s32(b, a); }
+	static TRANSFORM_KERNEL_INLINE I shift_to_sign(I a) { return vshlq_n_s32(a, 29); }
+	static TRANSFORM_KERNEL_INLINE I iequal(I a, I b) { return vreinterpretq_s32_u32(vceqq_s32(a, b)); }
+	static TRANSFORM_KERNEL_INLINE bool any_greater(F a, F b) { return vmaxvq_u32(vcgtq_f32(a, b)) != 0; }
+	static TRANSFORM_KERNEL_INLINE uint32_t less_mask(F a, F b) {
+		const uint32x4_t lane_bits = { 1, 2, 4, 8 };
+		return vaddvq_u32(vandq_u32(vcltq_f32(a, b), lane_bits));
+	}
+};
+#endif
+
+#ifdef TRANSFORM_KERNEL_WASM
+struct Wasm {
+	static constexpr size_t width = 4;
+	using F = v128_t;
+	using I = v128_t;
+	static TRANSFORM_KERNEL_INLINE F load(const float* p) { return wasm_v128_load(p); }
+	static TRANSFORM_KERNEL_INLINE void store(float* p, F a) { wasm_v128_store(p, a); }
+	static TRANSFORM_KERNEL_INLINE F set(float a) { return wasm_f32x4_splat(a); }
+	static TRANSFORM_KERNEL_INLINE I iset(int32_t a) { return wasm_i32x4_splat(a); }
+	static TRANSFORM_KERNEL_INLINE F add(F a, F b) { return wasm_f32x4_add(a, b); }
+	static TRANSFORM_KERNEL_INLINE F sub(F a, F b) { return wasm_f32x4_sub(a, b); }
+	static TRANSFORM_KERNEL_INLINE F mul(F a, F b) { return wasm_f32x4_mul(a, b); }
+	static TRANSFORM_KERNEL_INLINE F bit_and(F a, F b) { return wasm_v128_and(a, b); }
+	static TRANSFORM_KERNEL_INLINE F bit_andnot(F a, F b) { return wasm_v128_andnot(b, a); }
+	static TRANSFORM_KERNEL_INLINE F bit_xor(F a, F b) { return wasm_v128_xor(a, b); }
+	static TRANSFORM_KERNEL_INLINE I truncate(F a) { return wasm_i32x4_trunc_sat_f32x4(a); }
+	static TRANSFORM_KERNEL_INLINE F to_float(I a) { return wasm_f32x4_convert_i32x4(a); }
+	static TRANSFORM_KERNEL_INLINE F as_float(I a) { return a; }
+	static TRANSFORM_KERNEL_INLINE I iadd(I a, I b) { return wasm_i32x4_add(a, b); }
+	static TRANSFORM_KERNEL_INLINE I isub(I a, I b) { return wasm_i32x4_sub(a, b); }
+	static TRANSFORM_KERNEL_INLINE I iand(I a, I b) { return wasm_v128_and(a, b); }
+	static TRANSFORM_KERNEL_INLINE I iandnot(I a, I b) { return wasm_v128_andnot(b, a); }
+	static TRANSFORM_KERNEL_INLINE I shift_to_sign(I a) { return wasm_i32x4_shl(a, 29); }
+	static TRANSFORM_KERNEL_INLINE I iequal(I a, I b) { return wasm_i32x4_eq(a, b); }
+	static TRANSFORM_KERNEL_INLINE bool any_greater(F a, F b) { return wasm_v128_any_true(wasm_f32x4_gt(a, b)); }
+	static TRANSFORM_KERNEL_INLINE uint32_t less_mask(F a, F b) { return wasm_i32x4_bitmask(wasm_f32x4_lt(a, b)); }
+};
+#endif
+
+// sin and cos of every lane; bit_andnot(a, b) is ~a & b
+template<class S>
+TRANSFORM_KERNEL_INLINE void sincos(const typename S::F& angle, typename S::F& sin, typename S::F& cos) {
+	using F = typename S::F;
+	using I = typename S::I;
+	F x = angle;
+	const F sign_mask = S::set(-0.f);
+	F sin_sign = S::bit_and(x, sign_mask);
+	x = S::bit_andnot(sign_mask, x);
+
+	// the octant, rounded up to even
+	I octant = S::truncate(S::mul(x, S::set(1.27323954473516f)));
+	octant = S::iand(S::iadd(octant, S::iset(1)), S::iset(~1));
+	F y = S::to_float(octant);
+	F sin_swap = S::as_float(S::shift_to_sign(S::iand(octant, S::iset(4))));
+	F cos_sign = S::as_float(S::shift_to_sign(S::iandnot(S::isub(octant, S::iset(2)), S::iset(4))));
+	F use_sin_poly = S::as_float(S::iequal(S::iand(octant, S::iset(2)), S::iset(0)));
+	sin_sign = S::bit_xor(sin_sign, sin_swap);
+
+	// x - y * pi / 4 in extended precision
+	x = S::add(x, S::mul(y, S::set(-0.78515625f)));
+	x = S::add(x, S::mul(y, S::set(-2.4187564849853515625e-4f)));
+	x = S::add(x, S::mul(y, S::set(-3.77489497744594108e-8f)));
+	F z = S::mul(x, x);
+
+	F cos_poly = S::set(2.443315711809948e-5f);
+	cos_poly = S::add(S::mul(cos_poly, z), S::set(-1.388731625493765e-3f));
+	cos_poly = S::add(S::mul(cos_poly, z), S::set(4.166664568298827e-2f));
+	cos_poly = S::mul(S::mul(cos_poly, z), z);
+	cos_poly = S::add(S::sub(cos_poly, S::mul(z, S::set(0.5f))), S::set(1.f));
+
+	F sin_poly = S::set(-1.9515295891e-4f);
+	sin_poly = S::add(S::mul(sin_poly, z), S::set(8.3321608736e-3f));
+	sin_poly = S::add(S::mul(sin_poly, z), S::set(-1.6666654611e-1f));
+	sin_poly = S::add(S::mul(S::mul(sin_poly, z), x), x);
+
+	F sin_value = S::add(S::bit_and(use_sin_poly, sin_poly), S::bit_andnot(use_sin_poly, cos_poly));
+	F cos_value = S::add(S::bit_andnot(use_sin_poly, sin_poly), S::bit_and(use_sin_poly, cos_poly));
+	sin = S::bit_xor(sin_value, sin_sign);
+	cos = S::bit_xor(cos_value, cos_sign);
+}
+
+template<class S>
+TRANSFORM_KERNEL_INLINE void convert(const Streams& in, size_t count, glm::mat4* const* out) {
+	using F = typename S::F;
+	alignas(32) float entries[12][batch_size];
+	const auto& v = in.values;
+	const F sign_mask = S::set(-0.f);
+	const F limit = S::set(max_angle);
+	size_t vector_end = count - count % S::width;
+	for (size_t i = 0; i < vector_end; i += S::width) {
+		F yaw = S::bit_xor(S::load(&v[RotationX][i]), sign_mask);
+		F pitch = S::load(&v[RotationZ][i]);
+		F roll = S::load(&v[RotationY][i]);
+		if (S::any_greater(S::bit_andnot(sign_mask, yaw), limit) || S::any_greater(S::bit_andnot(sign_mask, pitch), limit)
+			|| S::any_greater(S::bit_andnot(sign_mask, roll), limit)) {
+			convert_scalar(in, i, S::width, out);
+			continue;
+		}
+		F sh, ch, sp, cp, sb, cb;
+		sincos<S>(yaw, sh, ch);
+		sincos<S>(pitch, sp, cp);
+		sincos<S>(roll, sb, cb);
+		F sx = S::load(&v[ScaleX][i]);
+		F sy = S::load(&v[ScaleY][i]);
+		F sz = S::load(&v[ScaleZ][i]);
+		F neg_sh = S::bit_xor(sh, sign_mask);
+		F neg_ch = S::bit_xor(ch, sign_mask);
+		// the expressions and operand order of glm::yawPitchRoll, each column times its scale
+		S::store(&entries[0][i], S::mul(S::add(S::mul(ch, cb), S::mul(S::mul(sh, sp), sb)), sx));
+		S::store(&entries[1][i], S::mul(S::mul(sb, cp), sx));
+		S::store(&entries[2][i], S::mul(S::add(S::mul(neg_sh, cb), S::mul(S::mul(ch, sp), sb)), sx));
+		S::store(&entries[3][i], S::mul(S::add(S::mul(neg_ch, sb), S::mul(S::mul(sh, sp), cb)), sy));
+		S::store(&entries[4][i], S::mul(S::mul(cb, cp), sy));
+		S::store(&entries[5][i], S::mul(S::add(S::mul(sb, sh), S::mul(S::mul(ch, sp), cb)), sy));
+		S::store(&entries[6][i], S::mul(S::mul(sh, cp), sz));
+		S::store(&entries[7][i], S::mul(S::bit_xor(sp, sign_mask), sz));
+		S::store(&entries[8][i], S::mul(S::mul(ch, cp), sz));
+		S::store(&entries[9][i], S::load(&v[TranslationX][i]));
+		S::store(&entries[10][i], S::load(&v[TranslationY][i]));
+		S::store(&entries[11][i], S::load(&v[TranslationZ][i]));
+		store_columns(entries, i, S::width, out);
+	}
+	convert_scalar(in, vector_end, count - vector_end, out);
+}
+
+template<class S>
+TRANSFORM_KERNEL_INLINE typename S::F plane_distance(const glm::vec4& plane, const typename S::F& x, const typename S::F& y, const typename S::F& z) {
+	return S::add(S::add(S::mul(S::set(plane.x), x), S::mul(S::set(plane.y), y)), S::add(S::mul(S::set(plane.z), z), S::set(plane.w)));
+}
+
+template<class S>
+TRANSFORM_KERNEL_INLINE uint64_t cull(const Spheres& in, size_t count, const Frustum& frustum) {
+	using F = typename S::F;
+	const auto& v = in.values;
+	const uint32_t all_lanes = (1u << S::width) - 1;
+	uint64_t visible = 0;
+	size_t vector_end = count - count % S::width;
+	for (size_t i = 0; i < vector_end; i += S::width) {
+		F x = S::load(&v[CenterX][i]);
+		F y = S::load(&v[CenterY][i]);
+		F z = S::load(&v[CenterZ][i]);
+		F radius = S::load(&v[Radius][i]);
+		F neg_radius = S::bit_xor(radius, S::set(-0.f));
+		uint32_t culled = S::less_mask(S::mul(radius, S::set(frustum.pixel_scale)), S::mul(plane_distance<S>(frustum.depth, x, y, z), S::set(frustum.min_pixels)));
+		for (int plane = 0; plane < 6; plane++) {
+			culled |= S::less_mask(plane_distance<S>(frustum.planes[plane], x, y, z), neg_radius);
+		}
+		visible |= static_cast<uint64_t>(~culled & all_lanes) << i;
+	}
+	return visible | cull_scalar(in, vector_end, count - vector_end, frustum);
+}
+
+#ifdef TRANSFORM_KERNEL_X86
+inline void kernel_sse2(const Streams& in, size_t count, glm::mat4* const* out) {
+	convert<Sse2>(in, count, out);
+}
+
+inline uint64_t cull_sse2(const Spheres& in, size_t count, const Frustum& frustum) {
+	return cull<Sse2>(in, count, frustum);
+}
+
+TRANSFORM_KERNEL_AVX2_ENTRY inline void kernel_avx2(const Streams& in, size_t count, glm::mat4* const* out) {
+	convert<Avx2>(in, count, out);
+}
+
+TRANSFORM_KERNEL_AVX2_ENTRY inline uint64_t cull_avx2(const Spheres& in, size_t count, const Frustum& frustum) {
+	return cull<Avx2>(in, count, frustum);
+}
+
+inline bool has_avx2() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+	__cpuid(info, 1);
+	// the OS has to save the ymm registers too
+	bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+	__cpuidex(info, 7, 0);
+	return os_saves_ymm && (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+struct Selected {
+	Kernel kernel;
+	CullKernel cull;
+	const char* name;
+};
+
+// the widest kernel this CPU runs, chosen once
+inline const Selected& best() {
+	static const Selected selected = []() -> Selected {
+#if defined(TRANSFORM_KERNEL_X86)
+		if (has_avx2()) {
+			return { &kernel_avx2, &cull_avx2, "AVX2" };
+		}
+		return { &kernel_sse2, &cull_sse2, "SSE2" };
+#elif defined(TRANSFORM_KERNEL_NEON)
+		return {
+			[](const Streams& in, size_t count, glm::mat4* const* out) { convert<Neon>(in, count, out); },
+			[](const Spheres& in, size_t count, const Frustum& frustum) { return cull<Neon>(in, count, frustum); },
+			"NEON",
+		};
+#elif defined(TRANSFORM_KERNEL_WASM)
+		return {
+			[](const Streams& in, size_t count, glm::mat4* const* out) { convert<Wasm>(in, count, out); },
+			[](const Spheres& in, size_t count, const Frustum& frustum) { return cull<Wasm>(in, count, frustum); },
+			"WebAssembly SIMD",
+		};
+#else
+		return { &kernel_scalar, &cull_kernel_scalar, "scalar" };
+#endif
+	}();
+	return selected;
+}
+
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif